@@ -0,0 +1,195 @@
+/*
+ * 位置表的性能测试：在1k和10k个表项下测量LookupRoute、Update、Purge和邻居查找的耗时，
+ * 并比较1k和5k个节点时使用和不使用共享位置存储每个表项占用的内存
+ *
+ * ./waf --run "myprotocol4-rtable-benchmark --iterations=1000000 --tables=16 --versions=2"
+ */
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <vector>
+#include "ns3/core-module.h"
+#include "ns3/myprotocol4-rtable.h"
+#include "ns3/myprotocol4-position-store.h"
+
+using namespace ns3;
+using namespace ns3::myprotocol4;
+
+NS_LOG_COMPONENT_DEFINE ("Myprotocol4RtableBenchmark");
+
+/// first address of the generated entries
+static const uint32_t BASE_ADDRESS = 0x0a000001;
+
+/// \returns the nanoseconds per operation since start
+static double
+NanoSecondsPerOp (std::chrono::steady_clock::time_point start, uint32_t ops)
+{
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now () - start;
+  return elapsed.count () / ops;
+}
+
+/**
+ * Fill a table with n entries spread over the simulation area and time
+ * every operation on it.
+ * \param n the number of entries
+ * \param iterations the number of lookups and updates, neighbor scans and purges run fewer times
+ * \param shared true to keep the reports in a shared position store
+ */
+static void
+RunBenchmark (uint32_t n, uint32_t iterations, bool shared)
+{
+  int64_t now = Simulator::Now ().ToInteger (Time::S);
+  RoutingTable table;
+  if (shared)
+    {
+      table.SetPositionStore (Create<PositionStore> ());
+    }
+  for (uint32_t k = 0; k < n; ++k)
+    {
+      RoutingTableEntry entry (k % 1000, (k * 7) % 1000, k % 300, (int16_t) (k % 21) - 10, (int16_t) ((k * 3) % 21) - 10, 0,
+                               now - k % 5, Ipv4Address (BASE_ADDRESS + k));
+      table.Update (entry);
+    }
+
+  // 用乘法散列打乱访问顺序，避免顺序访问带来的缓存优势
+  RoutingTableEntry found;
+  uint64_t checksum = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  for (uint32_t r = 0; r < iterations; ++r)
+    {
+      if (table.LookupRoute (Ipv4Address (BASE_ADDRESS + (r * 2654435761u) % n), found))
+        {
+          checksum += found.GetX ();
+        }
+    }
+  double lookup = NanoSecondsPerOp (start, iterations);
+
+  start = std::chrono::steady_clock::now ();
+  for (uint32_t r = 0; r < iterations; ++r)
+    {
+      uint32_t k = (r * 2654435761u) % n;
+      RoutingTableEntry entry ((k + r) % 1000, (k * 7) % 1000, k % 300, (int16_t) (k % 21) - 10, (int16_t) ((k * 3) % 21) - 10, 0,
+                               now, Ipv4Address (BASE_ADDRESS + k));
+      table.Update (entry);
+    }
+  double update = NanoSecondsPerOp (start, iterations);
+
+  uint32_t scans = std::max<uint32_t> (iterations / 100, 1);
+  start = std::chrono::steady_clock::now ();
+  for (uint32_t r = 0; r < scans; ++r)
+    {
+      Vector myPos ((r * 37) % 1000, (r * 91) % 1000, 0);
+      Vector dstPos = table.PredictPosition (Ipv4Address (BASE_ADDRESS + (r * 2654435761u) % n));
+      Ipv4Address nextHop;
+      checksum += table.LookupNextHop (myPos, dstPos, nextHop);
+    }
+  double nextHop = NanoSecondsPerOp (start, scans);
+
+  start = std::chrono::steady_clock::now ();
+  for (uint32_t r = 0; r < scans; ++r)
+    {
+      std::map<Ipv4Address, RoutingTableEntry> neighbors;
+      table.LookupNeighbor (neighbors, Vector ((r * 37) % 1000, (r * 91) % 1000, 0));
+      checksum += neighbors.size ();
+    }
+  double neighbor = NanoSecondsPerOp (start, scans);
+
+  start = std::chrono::steady_clock::now ();
+  for (uint32_t r = 0; r < scans; ++r)
+    {
+      table.Purge ();
+    }
+  double purge = NanoSecondsPerOp (start, scans);
+
+  std::cout << std::fixed << std::setprecision (1)
+            << "entries " << n
+            << (shared ? "\tshared store" : "\tper-node records")
+            << "\tLookupRoute " << lookup << " ns"
+            << "\tUpdate " << update << " ns"
+            << "\tLookupNextHop " << nextHop << " ns"
+            << "\tLookupNeighbor " << neighbor << " ns"
+            << "\tPurge " << purge << " ns"
+            << "\t(checksum " << checksum << ")" << std::endl;
+}
+
+/**
+ * Build tables of a network of n nodes in which every node knows every
+ * other node, as after network-wide flooding, and report the bytes per
+ * entry. Only some of the n tables are built; they are all alike, and the
+ * store holds the same records however many tables reference them.
+ * \param n the number of nodes, which is also the number of entries per table
+ * \param tables the number of tables built
+ * \param versions the number of versions of each report held across the tables
+ * \param shared true to keep the reports in a shared position store
+ */
+static void
+MeasureMemory (uint32_t n, uint32_t tables, uint32_t versions, bool shared)
+{
+  int64_t now = Simulator::Now ().ToInteger (Time::S);
+  Ptr<PositionStore> store;
+  if (shared)
+    {
+      store = Create<PositionStore> ();
+    }
+  std::vector<RoutingTable *> built;
+  uint64_t tableBytes = 0;
+  for (uint32_t t = 0; t < tables; ++t)
+    {
+      RoutingTable *table = new RoutingTable ();
+      table->SetPositionStore (store);
+      // 不同节点收到的同一个源节点的报告有versions个版本
+      uint16_t age = t % versions;
+      for (uint32_t k = 0; k < n; ++k)
+        {
+          RoutingTableEntry entry (k % 1000, (k * 7) % 1000, k % 300, (int16_t) (k % 21) - 10, (int16_t) ((k * 3) % 21) - 10, 0,
+                                   now - age, Ipv4Address (BASE_ADDRESS + k));
+          table->Update (entry);
+        }
+      // 预测位置和网格在第一次查询时建立
+      table->PredictPosition (Ipv4Address (BASE_ADDRESS));
+      tableBytes += table->GetMemoryUsage ();
+      built.push_back (table);
+    }
+  double perTable = (double) tableBytes / tables;
+  uint64_t storeBytes = shared ? store->GetMemoryUsage () : 0;
+  // n个节点的总内存：每个节点一张表，加上所有节点共享的存储
+  double total = perTable * n + storeBytes;
+  std::cout << std::fixed << std::setprecision (1)
+            << "nodes " << n
+            << (shared ? "\tshared store" : "\tper-node records")
+            << "\ttable " << perTable / n << " B/entry"
+            << "\tstore " << (double) storeBytes / n / n << " B/entry"
+            << "\ttotal " << total / n / n << " B/entry, " << total / (1 << 20) << " MiB" << std::endl;
+  for (uint32_t t = 0; t < built.size (); ++t)
+    {
+      delete built[t];
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t iterations = 1000000;
+  uint32_t tables = 16;
+  uint32_t versions = 2;
+  CommandLine cmd;
+  cmd.AddValue ("iterations", "Number of lookups and updates per table size", iterations);
+  cmd.AddValue ("tables", "Number of tables built for the memory measurement", tables);
+  cmd.AddValue ("versions", "Number of versions of each report held across the tables", versions);
+  cmd.Parse (argc, argv);
+
+  // 表项的时间戳和过期都以仿真时间的秒为单位，在仿真运行中测量
+  Simulator::Schedule (Seconds (10), &RunBenchmark, 1000, iterations, false);
+  Simulator::Schedule (Seconds (10), &RunBenchmark, 10000, iterations, false);
+  Simulator::Schedule (Seconds (10), &RunBenchmark, 1000, iterations, true);
+  Simulator::Schedule (Seconds (10), &RunBenchmark, 10000, iterations, true);
+  Simulator::Schedule (Seconds (10), &MeasureMemory, 1000, tables, versions, false);
+  Simulator::Schedule (Seconds (10), &MeasureMemory, 1000, tables, versions, true);
+  Simulator::Schedule (Seconds (10), &MeasureMemory, 5000, tables, versions, false);
+  Simulator::Schedule (Seconds (10), &MeasureMemory, 5000, tables, versions, true);
+  Simulator::Run ();
+  Simulator::Destroy ();
+  return 0;
+}
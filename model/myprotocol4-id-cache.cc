@@ -6,6 +6,21 @@ namespace myprotocol4 {
 bool
 IdCache::IsDuplicate (Ipv4Address addr, uint16_t timestamp)
 {
+  if (m_highWaterMark)
+    {
+      std::pair<std::unordered_map<uint32_t, uint16_t>::iterator, bool> i =
+        m_newest.insert (std::make_pair (addr.Get (), timestamp));
+      if (i.second)
+        {
+          return false;
+        }
+      if (timestamp <= i.first->second)
+        {
+          return true;
+        }
+      i.first->second = timestamp;
+      return false;
+    }
   Purge ();
   for (std::vector<UniqueId>::const_iterator i = m_idCache.begin ();
        i != m_idCache.end (); ++i)
@@ -32,6 +47,10 @@ IdCache::Purge ()
 uint32_t
 IdCache::GetSize ()
 {
+  if (m_highWaterMark)
+    {
+      return m_newest.size ();
+    }
   Purge ();
   return m_idCache.size ();
 }
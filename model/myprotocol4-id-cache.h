@@ -4,17 +4,20 @@
 #include "ns3/ipv4-address.h"
 #include "ns3/simulator.h"
 #include <vector>
+#include <unordered_map>
 
 namespace ns3 {
 namespace myprotocol4 {
 class IdCache
 {
 public:
-  IdCache (Time lifetime) : m_lifetime (lifetime)
+  IdCache (Time lifetime) : m_lifetime (lifetime), m_highWaterMark (false)
   {
   }
   /**
    * Check that entry (addr, id) exists in cache. Add entry, if it doesn't exist.
+   * In high-water mark mode, every timestamp not newer than the newest one
+   * seen from addr is a duplicate.
    * \param addr the IP address
    * \param id the cache entry ID
    * \returns true if the pair exists
@@ -42,6 +45,26 @@ public:
   {
     return m_lifetime;
   }
+  /**
+   * Switch between the time-window cache and per-origin high-water marks.
+   * Timestamps of one origin only increase, so the newest timestamp of each
+   * origin is enough to detect duplicates in constant time and memory per
+   * node. Switching clears the cache.
+   * \param enable true to keep only the newest timestamp of each origin
+   */
+  void SetHighWaterMark (bool enable)
+  {
+    m_highWaterMark = enable;
+    m_idCache.clear ();
+    m_newest.clear ();
+  }
+  /**
+   * \returns true if per-origin high-water marks are used
+   */
+  bool GetHighWaterMark () const
+  {
+    return m_highWaterMark;
+  }
 private:
   /// Unique packet ID
   struct UniqueId
@@ -64,6 +87,10 @@ private:
   std::vector<UniqueId> m_idCache;
   /// Default lifetime for ID records
   Time m_lifetime;
+  /// Use m_newest instead of m_idCache
+  bool m_highWaterMark;
+  /// Origin address -> newest timestamp seen from it
+  std::unordered_map<uint32_t, uint16_t> m_newest;
 };
 
 } 
@@ -18,7 +18,8 @@ MyprotocolHeader::MyprotocolHeader (uint16_t x, uint16_t y, uint16_t z, uint16_t
     m_sign(sign),
     m_timestamp(timestamp),
     m_myadress(myadress),
-    m_uid(uid)
+    m_uid(uid),
+    m_analysisInTag (false)
 {
 }
 
@@ -42,11 +43,14 @@ MyprotocolHeader::GetInstanceTypeId () const
   return GetTypeId ();
 }
 
-// 包头长度：8*1 + 4*1 + 2*8 = 28
+/// Flag in the low byte of the serialized sign field: the uid is carried in an AnalysisTag
+static const uint16_t SIGN_UID_IN_TAG = 0x0080;
+
+// 包头长度：8*1 + 4*1 + 2*8 = 28，uid放在tag中时为20
 uint32_t
 MyprotocolHeader::GetSerializedSize () const
 {
-  return 28;
+  return m_analysisInTag ? 20 : 28;
 }
 
 void
@@ -59,9 +63,12 @@ MyprotocolHeader::Serialize (Buffer::Iterator i) const
   i.WriteHtonU16 (m_vx);
   i.WriteHtonU16 (m_vy);
   i.WriteHtonU16 (m_vz);
-  i.WriteHtonU16(m_sign);
+  i.WriteHtonU16(m_sign | (m_analysisInTag ? SIGN_UID_IN_TAG : 0));
   i.WriteHtonU16 (m_timestamp);
-  i.WriteHtonU64 (m_uid);
+  if (!m_analysisInTag)
+    {
+      i.WriteHtonU64 (m_uid);
+    }
   WriteTo (i, m_myadress);
 }
 
@@ -77,8 +84,11 @@ MyprotocolHeader::Deserialize (Buffer::Iterator start)
   m_vy = i.ReadNtohU16 ();
   m_vz = i.ReadNtohU16 ();
   m_sign = i.ReadNtohU16();
+  m_analysisInTag = m_sign & SIGN_UID_IN_TAG;
+  m_sign &= ~SIGN_UID_IN_TAG;
   m_timestamp = i.ReadNtohU16 ();
-  m_uid = i.ReadNtohU64 ();
+  // uid在tag中时由接收端从tag中恢复
+  m_uid = m_analysisInTag ? 0 : i.ReadNtohU64 ();
   ReadFrom (i, m_myadress);
 
   uint32_t dist = i.GetDistanceFrom (start);
@@ -123,7 +133,9 @@ DataHeader::DataHeader (uint16_t dstPosx, uint16_t dstPosy, uint16_t dstPosz,
     m_inRec (inRec),
     m_uid(uid),
     m_hop(hop),
-    m_error(error)
+    m_error(error),
+    m_compact (false),
+    m_analysisInTag (false)
 {
 }
 
@@ -143,16 +155,150 @@ DataHeader::GetInstanceTypeId () const
   return GetTypeId ();
 }
 
-// 数据头大小2*14 + 8*1 = 36
+/// Flags byte of the compact DataHeader format
+enum DataHeaderFlags
+{
+  DATA_COMPACT = 0x80,          ///< compact format, never set in the first byte of the fixed format (dstPosx <= 1000)
+  DATA_IN_REC = 0x40,           ///< recovery mode, the recovery position follows the timestamp
+  DATA_WIDE_POSITIONS = 0x20,   ///< positions are written as three 16-bit fields instead of 29 packed bits
+  DATA_ANALYSIS_IN_TAG = 0x10,  ///< uid and error are carried in an AnalysisTag
+  DATA_SIGN_MASK = 0x07         ///< velocity sign of the destination
+};
+
+/// Flag in the inRec field of the fixed format: uid and error are carried in an AnalysisTag
+static const uint16_t IN_REC_ANALYSIS_IN_TAG = 0x8000;
+
+/// \returns the number of bytes of v as a LEB128 varint
+static uint32_t
+VarintSize (uint64_t v)
+{
+  uint32_t size = 1;
+  while (v >= 0x80)
+    {
+      v >>= 7;
+      size++;
+    }
+  return size;
+}
+
+static void
+WriteVarint (Buffer::Iterator & i, uint64_t v)
+{
+  while (v >= 0x80)
+    {
+      i.WriteU8 ((v & 0x7f) | 0x80);
+      v >>= 7;
+    }
+  i.WriteU8 (v);
+}
+
+static uint64_t
+ReadVarint (Buffer::Iterator & i)
+{
+  uint64_t v = 0;
+  for (uint32_t shift = 0; shift < 64; shift += 7)
+    {
+      uint8_t b = i.ReadU8 ();
+      v |= (uint64_t)(b & 0x7f) << shift;
+      if (!(b & 0x80))
+        {
+          break;
+        }
+    }
+  return v;
+}
+
+static void
+WritePosition (Buffer::Iterator & i, bool wide, uint16_t x, uint16_t y, uint16_t z)
+{
+  if (wide)
+    {
+      i.WriteHtonU16 (x);
+      i.WriteHtonU16 (y);
+      i.WriteHtonU16 (z);
+    }
+  else
+    {
+      i.WriteHtonU32 ((uint32_t) x << 19 | (uint32_t) y << 9 | z);
+    }
+}
+
+static void
+ReadPosition (Buffer::Iterator & i, bool wide, uint16_t & x, uint16_t & y, uint16_t & z)
+{
+  if (wide)
+    {
+      x = i.ReadNtohU16 ();
+      y = i.ReadNtohU16 ();
+      z = i.ReadNtohU16 ();
+    }
+  else
+    {
+      uint32_t packed = i.ReadNtohU32 ();
+      x = packed >> 19;
+      y = (packed >> 9) & 0x3ff;
+      z = packed & 0x1ff;
+    }
+}
+
+bool
+DataHeader::UseCompact () const
+{
+  return m_compact && m_dstSign <= DATA_SIGN_MASK && m_inRec <= 1;
+}
+
+bool
+DataHeader::NeedsWidePositions () const
+{
+  return m_dstPosx > 0x3ff || m_dstPosy > 0x3ff || m_dstPosz > 0x1ff
+         || (m_inRec && (m_recPosx > 0x3ff || m_recPosy > 0x3ff || m_recPosz > 0x1ff));
+}
+
+// 数据头大小2*14 + 8*1 = 36，uid和error放在tag中时为26，紧凑格式在典型取值下约15字节
 uint32_t
 DataHeader::GetSerializedSize () const
 {
-  return 36;
+  if (!UseCompact ())
+    {
+      return m_analysisInTag ? 26 : 36;
+    }
+  uint32_t position = NeedsWidePositions () ? 6 : 4;
+  return 1 + position
+         + VarintSize (m_dstVelx) + VarintSize (m_dstVely) + VarintSize (m_dstVelz)
+         + VarintSize (m_dstTimestamp)
+         + (m_inRec ? position : 0)
+         + VarintSize (m_hop)
+         + (m_analysisInTag ? 0 : VarintSize (m_uid) + VarintSize (m_error));
 }
 
 void
 DataHeader::Serialize (Buffer::Iterator i) const
 {
+  if (UseCompact ())
+    {
+      bool wide = NeedsWidePositions ();
+      i.WriteU8 (DATA_COMPACT | (m_inRec ? DATA_IN_REC : 0) | (wide ? DATA_WIDE_POSITIONS : 0)
+                 | (m_analysisInTag ? DATA_ANALYSIS_IN_TAG : 0) | m_dstSign);
+      WritePosition (i, wide, m_dstPosx, m_dstPosy, m_dstPosz);
+      WriteVarint (i, m_dstVelx);
+      WriteVarint (i, m_dstVely);
+      WriteVarint (i, m_dstVelz);
+      WriteVarint (i, m_dstTimestamp);
+      if (m_inRec)
+        {
+          WritePosition (i, wide, m_recPosx, m_recPosy, m_recPosz);
+        }
+      if (!m_analysisInTag)
+        {
+          WriteVarint (i, m_uid);
+        }
+      WriteVarint (i, m_hop);
+      if (!m_analysisInTag)
+        {
+          WriteVarint (i, m_error);
+        }
+      return;
+    }
   i.WriteHtonU16 (m_dstPosx);
   i.WriteHtonU16 (m_dstPosy);
   i.WriteHtonU16 (m_dstPosz);
@@ -164,31 +310,67 @@ DataHeader::Serialize (Buffer::Iterator i) const
   i.WriteHtonU16 (m_recPosx);
   i.WriteHtonU16 (m_recPosy);
   i.WriteHtonU16 (m_recPosz);
-  i.WriteHtonU16 (m_inRec);
-  i.WriteHtonU64 (m_uid);
+  i.WriteHtonU16 (m_inRec | (m_analysisInTag ? IN_REC_ANALYSIS_IN_TAG : 0));
+  if (!m_analysisInTag)
+    {
+      i.WriteHtonU64 (m_uid);
+    }
   i.WriteHtonU16 (m_hop);
-  i.WriteHtonU16 (m_error);
+  if (!m_analysisInTag)
+    {
+      i.WriteHtonU16 (m_error);
+    }
 }
 
 uint32_t
 DataHeader::Deserialize (Buffer::Iterator start)
 {
   Buffer::Iterator i = start;
-  m_dstPosx = i.ReadNtohU16 ();
-  m_dstPosy = i.ReadNtohU16 ();
-  m_dstPosz = i.ReadNtohU16 ();
-  m_dstVelx = i.ReadNtohU16 ();
-  m_dstVely = i.ReadNtohU16 ();
-  m_dstVelz = i.ReadNtohU16 ();
-  m_dstSign = i.ReadNtohU16 ();
-  m_dstTimestamp = i.ReadNtohU16 ();
-  m_recPosx = i.ReadNtohU16 ();
-  m_recPosy = i.ReadNtohU16 ();
-  m_recPosz = i.ReadNtohU16 ();
-  m_inRec = i.ReadNtohU16 ();
-  m_uid = i.ReadNtohU64 ();
-  m_hop = i.ReadNtohU16 ();
-  m_error = i.ReadNtohU16 ();
+  if (i.PeekU8 () & DATA_COMPACT)
+    {
+      uint8_t flags = i.ReadU8 ();
+      bool wide = flags & DATA_WIDE_POSITIONS;
+      m_compact = true;
+      m_analysisInTag = flags & DATA_ANALYSIS_IN_TAG;
+      m_dstSign = flags & DATA_SIGN_MASK;
+      m_inRec = (flags & DATA_IN_REC) ? 1 : 0;
+      ReadPosition (i, wide, m_dstPosx, m_dstPosy, m_dstPosz);
+      m_dstVelx = ReadVarint (i);
+      m_dstVely = ReadVarint (i);
+      m_dstVelz = ReadVarint (i);
+      m_dstTimestamp = ReadVarint (i);
+      m_recPosx = 0;
+      m_recPosy = 0;
+      m_recPosz = 0;
+      if (m_inRec)
+        {
+          ReadPosition (i, wide, m_recPosx, m_recPosy, m_recPosz);
+        }
+      m_uid = m_analysisInTag ? 0 : ReadVarint (i);
+      m_hop = ReadVarint (i);
+      m_error = m_analysisInTag ? 0 : ReadVarint (i);
+    }
+  else
+    {
+      m_compact = false;
+      m_dstPosx = i.ReadNtohU16 ();
+      m_dstPosy = i.ReadNtohU16 ();
+      m_dstPosz = i.ReadNtohU16 ();
+      m_dstVelx = i.ReadNtohU16 ();
+      m_dstVely = i.ReadNtohU16 ();
+      m_dstVelz = i.ReadNtohU16 ();
+      m_dstSign = i.ReadNtohU16 ();
+      m_dstTimestamp = i.ReadNtohU16 ();
+      m_recPosx = i.ReadNtohU16 ();
+      m_recPosy = i.ReadNtohU16 ();
+      m_recPosz = i.ReadNtohU16 ();
+      m_inRec = i.ReadNtohU16 ();
+      m_analysisInTag = m_inRec & IN_REC_ANALYSIS_IN_TAG;
+      m_inRec &= ~IN_REC_ANALYSIS_IN_TAG;
+      m_uid = m_analysisInTag ? 0 : i.ReadNtohU64 ();
+      m_hop = i.ReadNtohU16 ();
+      m_error = m_analysisInTag ? 0 : i.ReadNtohU16 ();
+    }
 
   uint32_t dist = i.GetDistanceFrom (start);
   NS_ASSERT (dist == GetSerializedSize ());
@@ -232,5 +414,501 @@ DataHeader::operator== (DataHeader const & o) const
           m_recPosx == o.m_recPosx && m_recPosy == o.m_recPosy && m_recPosz == o.m_recPosz &&
            m_inRec == o.m_inRec && m_uid == o.m_uid && m_hop == o.m_hop && m_error == o.m_error);
 }
+
+NS_OBJECT_ENSURE_REGISTERED (DataHeaderView);
+
+DataHeaderView::DataHeaderView (uint32_t transportSize)
+  : m_transportSize (transportSize)
+{
+  NS_ASSERT (transportSize <= MAX_TRANSPORT_SIZE);
+}
+
+TypeId
+DataHeaderView::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::myprotocol4::DataHeaderView")
+    .SetParent<Header> ()
+    .SetGroupName ("Myprotocol4")
+    .AddConstructor<DataHeaderView> ();
+  return tid;
+}
+
+TypeId
+DataHeaderView::GetInstanceTypeId () const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+DataHeaderView::GetSerializedSize () const
+{
+  return m_transportSize + m_dataHeader.GetSerializedSize ();
+}
+
+void
+DataHeaderView::Serialize (Buffer::Iterator i) const
+{
+  i.Write (m_transport, m_transportSize);
+  m_dataHeader.Serialize (i);
+}
+
+uint32_t
+DataHeaderView::Deserialize (Buffer::Iterator start)
+{
+  Buffer::Iterator i = start;
+  i.Read (m_transport, m_transportSize);
+  i.Next (m_dataHeader.Deserialize (i));
+  return i.GetDistanceFrom (start);
+}
+
+void
+DataHeaderView::Print (std::ostream &os) const
+{
+  os << " transport: " << m_transportSize << " bytes" << m_dataHeader;
+}
+
+/// First byte of the records that are not a MyprotocolHeader
+enum RecordMarker
+{
+  RECORD_DELTA = 0x80,                  ///< DeltaHeader, the low bits are flags
+  RECORD_KEYFRAME_REQUEST = 0xc0,       ///< KeyframeRequestHeader
+  RECORD_LOCATION_REQUEST = 0x40,       ///< LocationRequestHeader
+  RECORD_LOCATION_REPLY = 0x60,         ///< LocationReplyHeader
+  RECORD_MARKER_MASK = 0xc0,
+  RECORD_LOCATION_MASK = 0xe0           ///< tells requests and replies apart
+};
+
+/// Flags in the first byte of a DeltaHeader
+enum DeltaFlags
+{
+  DELTA_UID_IN_TAG = 0x10,      ///< the uid is carried in an AnalysisTag
+  DELTA_SIGN_MASK = 0x07        ///< velocity sign
+};
+
+RecordType
+GetRecordType (uint8_t firstByte)
+{
+  switch (firstByte & RECORD_MARKER_MASK)
+    {
+    case RECORD_DELTA:
+      return DELTA_RECORD;
+    case RECORD_KEYFRAME_REQUEST:
+      return KEYFRAME_REQUEST;
+    case RECORD_LOCATION_REQUEST:
+      return (firstByte & RECORD_LOCATION_MASK) == RECORD_LOCATION_REPLY ? LOCATION_REPLY : LOCATION_REQUEST;
+    default:
+      return FULL_RECORD;
+    }
+}
+
+/// Write the address, kinematics and timestamp of a position update, 19 bytes
+static void
+WriteRecord (Buffer::Iterator & i, const MyprotocolHeader & record)
+{
+  WriteTo (i, record.GetMyadress ());
+  i.WriteHtonU16 (record.GetX ());
+  i.WriteHtonU16 (record.GetY ());
+  i.WriteHtonU16 (record.GetZ ());
+  i.WriteHtonU16 (record.GetVx ());
+  i.WriteHtonU16 (record.GetVy ());
+  i.WriteHtonU16 (record.GetVz ());
+  i.WriteU8 (record.GetSign ());
+  i.WriteHtonU16 (record.GetTimestamp ());
+}
+
+/// Read a position update written by WriteRecord, uid and scope are left at their defaults
+static void
+ReadRecord (Buffer::Iterator & i, MyprotocolHeader & record)
+{
+  Ipv4Address addr;
+  ReadFrom (i, addr);
+  record = MyprotocolHeader ();
+  record.SetMyadress (addr);
+  record.SetX (i.ReadNtohU16 ());
+  record.SetY (i.ReadNtohU16 ());
+  record.SetZ (i.ReadNtohU16 ());
+  record.SetVx (i.ReadNtohU16 ());
+  record.SetVy (i.ReadNtohU16 ());
+  record.SetVz (i.ReadNtohU16 ());
+  record.SetSign (i.ReadU8 ());
+  record.SetTimestamp (i.ReadNtohU16 ());
+}
+
+/// \returns v mapped to an unsigned value, small magnitudes to small values
+static uint32_t
+ZigZag (int32_t v)
+{
+  return ((uint32_t) v << 1) ^ (uint32_t)(v >> 31);
+}
+
+/// \returns the signed value of a ZigZag encoded value
+static int32_t
+UnZigZag (uint32_t v)
+{
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+NS_OBJECT_ENSURE_REGISTERED (DeltaHeader);
+
+DeltaHeader::DeltaHeader ()
+  : m_sign (0),
+    m_scope (0),
+    m_keyframeTimestamp (0),
+    m_dt (0),
+    m_dx (0),
+    m_dy (0),
+    m_dz (0),
+    m_dvx (0),
+    m_dvy (0),
+    m_dvz (0),
+    m_uid (0),
+    m_analysisInTag (false)
+{
+}
+
+TypeId
+DeltaHeader::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::myprotocol4::DeltaHeader")
+    .SetParent<Header> ()
+    .SetGroupName ("Myprotocol4")
+    .AddConstructor<DeltaHeader> ();
+  return tid;
+}
+
+TypeId
+DeltaHeader::GetInstanceTypeId () const
+{
+  return GetTypeId ();
+}
+
+void
+DeltaHeader::Encode (const MyprotocolHeader & keyframe, const MyprotocolHeader & update)
+{
+  m_sign = update.GetSign () & DELTA_SIGN_MASK;
+  m_scope = update.GetScope ();
+  m_myadress = update.GetMyadress ();
+  m_keyframeTimestamp = keyframe.GetTimestamp ();
+  // 时间戳差值按16位回绕计算，可以为负（中继转发的更新可能比它保存的关键帧旧）
+  m_dt = (int16_t)(update.GetTimestamp () - keyframe.GetTimestamp ());
+  m_dx = (int32_t) update.GetX () - keyframe.GetX ();
+  m_dy = (int32_t) update.GetY () - keyframe.GetY ();
+  m_dz = (int32_t) update.GetZ () - keyframe.GetZ ();
+  m_dvx = (int32_t) update.GetVx () - keyframe.GetVx ();
+  m_dvy = (int32_t) update.GetVy () - keyframe.GetVy ();
+  m_dvz = (int32_t) update.GetVz () - keyframe.GetVz ();
+  m_uid = update.GetUid ();
+  m_analysisInTag = update.IsAnalysisInTag ();
+}
+
+MyprotocolHeader
+DeltaHeader::Decode (const MyprotocolHeader & keyframe) const
+{
+  NS_ASSERT (keyframe.GetTimestamp () == m_keyframeTimestamp);
+  MyprotocolHeader update (keyframe.GetX () + m_dx, keyframe.GetY () + m_dy, keyframe.GetZ () + m_dz,
+                           keyframe.GetVx () + m_dvx, keyframe.GetVy () + m_dvy, keyframe.GetVz () + m_dvz,
+                           m_sign, GetTimestamp (), m_myadress, m_uid);
+  update.SetScope (m_scope);
+  update.SetAnalysisInTag (m_analysisInTag);
+  return update;
+}
+
+// 标志1 + 范围1 + 地址4 + 关键帧时间戳2 + 7个变长差值，稳定运动时每个差值1字节
+uint32_t
+DeltaHeader::GetSerializedSize () const
+{
+  return 8 + VarintSize (ZigZag (m_dt))
+         + VarintSize (ZigZag (m_dx)) + VarintSize (ZigZag (m_dy)) + VarintSize (ZigZag (m_dz))
+         + VarintSize (ZigZag (m_dvx)) + VarintSize (ZigZag (m_dvy)) + VarintSize (ZigZag (m_dvz))
+         + (m_analysisInTag ? 0 : VarintSize (m_uid));
+}
+
+void
+DeltaHeader::Serialize (Buffer::Iterator i) const
+{
+  i.WriteU8 (RECORD_DELTA | (m_analysisInTag ? DELTA_UID_IN_TAG : 0) | m_sign);
+  i.WriteU8 (m_scope);
+  WriteTo (i, m_myadress);
+  i.WriteHtonU16 (m_keyframeTimestamp);
+  WriteVarint (i, ZigZag (m_dt));
+  WriteVarint (i, ZigZag (m_dx));
+  WriteVarint (i, ZigZag (m_dy));
+  WriteVarint (i, ZigZag (m_dz));
+  WriteVarint (i, ZigZag (m_dvx));
+  WriteVarint (i, ZigZag (m_dvy));
+  WriteVarint (i, ZigZag (m_dvz));
+  if (!m_analysisInTag)
+    {
+      WriteVarint (i, m_uid);
+    }
+}
+
+uint32_t
+DeltaHeader::Deserialize (Buffer::Iterator start)
+{
+  Buffer::Iterator i = start;
+  uint8_t flags = i.ReadU8 ();
+  NS_ASSERT ((flags & RECORD_MARKER_MASK) == RECORD_DELTA);
+  m_sign = flags & DELTA_SIGN_MASK;
+  m_analysisInTag = flags & DELTA_UID_IN_TAG;
+  m_scope = i.ReadU8 ();
+  ReadFrom (i, m_myadress);
+  m_keyframeTimestamp = i.ReadNtohU16 ();
+  m_dt = UnZigZag (ReadVarint (i));
+  m_dx = UnZigZag (ReadVarint (i));
+  m_dy = UnZigZag (ReadVarint (i));
+  m_dz = UnZigZag (ReadVarint (i));
+  m_dvx = UnZigZag (ReadVarint (i));
+  m_dvy = UnZigZag (ReadVarint (i));
+  m_dvz = UnZigZag (ReadVarint (i));
+  // uid在tag中时由接收端从tag中恢复
+  m_uid = m_analysisInTag ? 0 : ReadVarint (i);
+  return i.GetDistanceFrom (start);
+}
+
+void
+DeltaHeader::Print (std::ostream &os) const
+{
+  os << " length: " << GetSerializedSize ()
+     << " keyframe: " << m_keyframeTimestamp
+     << " dt: " << m_dt
+     << " dX: " << m_dx
+     << " dY: " << m_dy
+     << " dZ: " << m_dz
+     << " dVX: " << m_dvx
+     << " dVY: " << m_dvy
+     << " dVZ: " << m_dvz
+     << " sign: " << (uint16_t) m_sign
+     << " scope: " << (uint16_t) m_scope
+     << " myadress: " << m_myadress
+     << " uid: " << m_uid;
+}
+
+NS_OBJECT_ENSURE_REGISTERED (KeyframeRequestHeader);
+
+KeyframeRequestHeader::KeyframeRequestHeader (Ipv4Address myadress, uint16_t timestamp)
+  : m_myadress (myadress),
+    m_timestamp (timestamp)
+{
+}
+
+TypeId
+KeyframeRequestHeader::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::myprotocol4::KeyframeRequestHeader")
+    .SetParent<Header> ()
+    .SetGroupName ("Myprotocol4")
+    .AddConstructor<KeyframeRequestHeader> ();
+  return tid;
+}
+
+TypeId
+KeyframeRequestHeader::GetInstanceTypeId () const
+{
+  return GetTypeId ();
+}
+
+// 标志1 + 地址4 + 时间戳2 = 7
+uint32_t
+KeyframeRequestHeader::GetSerializedSize () const
+{
+  return 7;
+}
+
+void
+KeyframeRequestHeader::Serialize (Buffer::Iterator i) const
+{
+  i.WriteU8 (RECORD_KEYFRAME_REQUEST);
+  WriteTo (i, m_myadress);
+  i.WriteHtonU16 (m_timestamp);
+}
+
+uint32_t
+KeyframeRequestHeader::Deserialize (Buffer::Iterator start)
+{
+  Buffer::Iterator i = start;
+  // 记录类型已由GetRecordType根据第一个字节判断
+  i.Next ();
+  ReadFrom (i, m_myadress);
+  m_timestamp = i.ReadNtohU16 ();
+  return i.GetDistanceFrom (start);
+}
+
+void
+KeyframeRequestHeader::Print (std::ostream &os) const
+{
+  os << " myadress: " << m_myadress
+     << " keyframe: " << m_timestamp;
+}
+
+NS_OBJECT_ENSURE_REGISTERED (LocationRequestHeader);
+
+LocationRequestHeader::LocationRequestHeader (Ipv4Address target, uint16_t id, uint8_t ttl,
+                                              const MyprotocolHeader & origin)
+  : m_target (target),
+    m_id (id),
+    m_ttl (ttl),
+    m_origin (origin)
+{
+}
+
+TypeId
+LocationRequestHeader::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::myprotocol4::LocationRequestHeader")
+    .SetParent<Header> ()
+    .SetGroupName ("Myprotocol4")
+    .AddConstructor<LocationRequestHeader> ();
+  return tid;
+}
+
+TypeId
+LocationRequestHeader::GetInstanceTypeId () const
+{
+  return GetTypeId ();
+}
+
+// 标志1 + TTL1 + id2 + 目标地址4 + 源节点的位置更新(地址4 + 2*6 + 符号1 + 时间戳2) = 27
+uint32_t
+LocationRequestHeader::GetSerializedSize () const
+{
+  return 27;
+}
+
+void
+LocationRequestHeader::Serialize (Buffer::Iterator i) const
+{
+  i.WriteU8 (RECORD_LOCATION_REQUEST);
+  i.WriteU8 (m_ttl);
+  i.WriteHtonU16 (m_id);
+  WriteTo (i, m_target);
+  WriteRecord (i, m_origin);
+}
+
+uint32_t
+LocationRequestHeader::Deserialize (Buffer::Iterator start)
+{
+  Buffer::Iterator i = start;
+  // 记录类型已由GetRecordType根据第一个字节判断
+  i.Next ();
+  m_ttl = i.ReadU8 ();
+  m_id = i.ReadNtohU16 ();
+  ReadFrom (i, m_target);
+  ReadRecord (i, m_origin);
+  return i.GetDistanceFrom (start);
+}
+
+void
+LocationRequestHeader::Print (std::ostream &os) const
+{
+  os << " target: " << m_target
+     << " id: " << m_id
+     << " ttl: " << (uint16_t) m_ttl
+     << " origin:" << m_origin;
+}
+
+NS_OBJECT_ENSURE_REGISTERED (LocationReplyHeader);
+
+LocationReplyHeader::LocationReplyHeader (const MyprotocolHeader & record)
+  : m_record (record)
+{
+}
+
+TypeId
+LocationReplyHeader::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::myprotocol4::LocationReplyHeader")
+    .SetParent<Header> ()
+    .SetGroupName ("Myprotocol4")
+    .AddConstructor<LocationReplyHeader> ();
+  return tid;
+}
+
+TypeId
+LocationReplyHeader::GetInstanceTypeId () const
+{
+  return GetTypeId ();
+}
+
+// 标志1 + 目标的位置更新(地址4 + 2*6 + 符号1 + 时间戳2) = 20
+uint32_t
+LocationReplyHeader::GetSerializedSize () const
+{
+  return 20;
+}
+
+void
+LocationReplyHeader::Serialize (Buffer::Iterator i) const
+{
+  i.WriteU8 (RECORD_LOCATION_REPLY);
+  WriteRecord (i, m_record);
+}
+
+uint32_t
+LocationReplyHeader::Deserialize (Buffer::Iterator start)
+{
+  Buffer::Iterator i = start;
+  // 记录类型已由GetRecordType根据第一个字节判断
+  i.Next ();
+  ReadRecord (i, m_record);
+  return i.GetDistanceFrom (start);
+}
+
+void
+LocationReplyHeader::Print (std::ostream &os) const
+{
+  os << " record:" << m_record;
+}
+
+NS_OBJECT_ENSURE_REGISTERED (AnalysisTag);
+
+AnalysisTag::AnalysisTag (uint64_t uid, uint16_t error)
+  : Tag (),
+    m_uid (uid),
+    m_error (error)
+{
+}
+
+TypeId
+AnalysisTag::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::myprotocol4::AnalysisTag")
+    .SetParent<Tag> ()
+    .SetGroupName ("Myprotocol4")
+    .AddConstructor<AnalysisTag> ();
+  return tid;
+}
+
+TypeId
+AnalysisTag::GetInstanceTypeId () const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+AnalysisTag::GetSerializedSize () const
+{
+  return sizeof (uint64_t) + sizeof (uint16_t);
+}
+
+void
+AnalysisTag::Serialize (TagBuffer i) const
+{
+  i.WriteU64 (m_uid);
+  i.WriteU16 (m_error);
+}
+
+void
+AnalysisTag::Deserialize (TagBuffer i)
+{
+  m_uid = i.ReadU64 ();
+  m_error = i.ReadU16 ();
+}
+
+void
+AnalysisTag::Print (std::ostream &os) const
+{
+  os << "AnalysisTag: uid = " << m_uid << " error = " << m_error;
+}
 }
 }
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include "ns3/header.h"
+#include "ns3/tag.h"
 #include "ns3/ipv4-address.h"
 #include "ns3/nstime.h"
 
@@ -59,10 +60,25 @@ public:
     return m_vz;
   }
   void SetSign(uint16_t sign){
-    m_sign = sign;
+    m_sign = (m_sign & 0xff00) | (sign & 0x00ff);
   }
   uint16_t GetSign() const{
-    return m_sign;
+    return m_sign & 0x00ff;
+  }
+  /**
+   * Set the dissemination scope, stored in the upper byte of the sign field
+   * \param scope the number of hops the update may still travel, 0 for no limit
+   */
+  void SetScope (uint8_t scope)
+  {
+    m_sign = (m_sign & 0x00ff) | (scope << 8);
+  }
+  /**
+   * \returns the number of hops the update may still travel, 0 for no limit
+   */
+  uint8_t GetScope () const
+  {
+    return m_sign >> 8;
   }
   void SetTimestamp(uint16_t timestamp){
     m_timestamp = timestamp;
@@ -88,6 +104,23 @@ public:
   {
     return m_uid;
   }
+  /**
+   * Leave the uid out of the serialized header. The sender carries it in an
+   * AnalysisTag byte tag over the record instead, a flag bit in the sign
+   * field tells the receiver that the field is missing.
+   * \param inTag true to leave the uid out of the header
+   */
+  void SetAnalysisInTag (bool inTag)
+  {
+    m_analysisInTag = inTag;
+  }
+  /**
+   * \returns true if the uid is carried in a tag instead of the header
+   */
+  bool IsAnalysisInTag () const
+  {
+    return m_analysisInTag;
+  }
 private:
   //ADD:添加位置信息、速度信息、时间戳
   uint16_t m_x;
@@ -96,10 +129,12 @@ private:
   uint16_t m_vx;
   uint16_t m_vy;
   uint16_t m_vz;
-  uint16_t m_sign;      //记录速度是否为负数，0:都不是负数，1:X轴速度为负，2:Y轴速度为负，3:Z轴速度为负,4：xy为负数，5：xz为负数，6：yz为负数，7：全部都是负数
+  uint16_t m_sign;      //高字节是传播范围(跳数，0表示不限)，低字节记录速度是否为负数，0:都不是负数，1:X轴速度为负，2:Y轴速度为负，3:Z轴速度为负,4：xy为负数，5：xz为负数，6：yz为负数，7：全部都是负数
   uint16_t m_timestamp;
   Ipv4Address m_myadress;
   uint64_t m_uid;
+  // ADD：uid只用于仿真分析，可以放在tag中而不占用空口开销
+  bool m_analysisInTag;
 };
 
 static inline std::ostream & operator<< (std::ostream& os, const MyprotocolHeader & packet)
@@ -124,6 +159,43 @@ public:
   uint32_t Deserialize (Buffer::Iterator start);
   void Print (std::ostream &os) const;
 
+  /**
+   * Select the wire format. The compact format starts with a flags byte
+   * holding the sign bits and the recovery flag, packs the positions into
+   * 29 bits, encodes the other fields as varints and leaves out the
+   * recovery position in greedy mode. Deserialize detects the format, so a
+   * forwarded header keeps the format of its sender.
+   * \param compact true for the compact format, false for the fixed 36 bytes
+   */
+  void SetCompact (bool compact)
+  {
+    m_compact = compact;
+  }
+  /**
+   * \returns true if the compact format is selected
+   */
+  bool IsCompact () const
+  {
+    return m_compact;
+  }
+  /**
+   * Leave uid and error out of the serialized header. The sender carries
+   * them in an AnalysisTag packet tag instead, a flag bit tells the
+   * receiver that the fields are missing.
+   * \param inTag true to leave uid and error out of the header
+   */
+  void SetAnalysisInTag (bool inTag)
+  {
+    m_analysisInTag = inTag;
+  }
+  /**
+   * \returns true if uid and error are carried in a tag instead of the header
+   */
+  bool IsAnalysisInTag () const
+  {
+    return m_analysisInTag;
+  }
+
   void SetDstPosx (uint16_t posx)
   {
     m_dstPosx = posx;
@@ -265,9 +337,344 @@ private:
   uint64_t m_uid;
   uint16_t m_hop;
   uint16_t m_error;
+
+  /// Use the compact format
+  bool m_compact;
+  /// uid and error are carried in an AnalysisTag
+  bool m_analysisInTag;
+  /**
+   * \returns true if the compact format is selected and can represent the sign and recovery flag
+   */
+  bool UseCompact () const;
+  /**
+   * \returns true if a position does not fit into the packed 10+10+9 bits
+   */
+  bool NeedsWidePositions () const;
 };
 
 std::ostream & operator<< (std::ostream & os, DataHeader const & h);
+
+/**
+ * \ingroup myprotocol4
+ * \brief The transport header of a data packet and the DataHeader behind it, as one chunk.
+ *
+ * A forwarder only changes fields of the DataHeader. Peeking the view reads
+ * both headers without copying the packet, and replacing the chunk costs one
+ * buffer reallocation, where removing and adding the two headers costs one
+ * reallocation per header. The transport header bytes are kept verbatim.
+ */
+class DataHeaderView : public Header
+{
+public:
+  /// The largest transport header that precedes a DataHeader (UDP)
+  static const uint32_t MAX_TRANSPORT_SIZE = 8;
+
+  /**
+   * \param transportSize the size of the transport header in front of the DataHeader
+   */
+  DataHeaderView (uint32_t transportSize = 0);
+
+  static TypeId GetTypeId ();
+  TypeId GetInstanceTypeId () const;
+  uint32_t GetSerializedSize () const;
+  void Serialize (Buffer::Iterator start) const;
+  uint32_t Deserialize (Buffer::Iterator start);
+  void Print (std::ostream &os) const;
+
+  /**
+   * \returns the size of the transport header in front of the DataHeader
+   */
+  uint32_t GetTransportSize () const
+  {
+    return m_transportSize;
+  }
+  /**
+   * \returns the DataHeader, whose fields may be changed before the view is added again
+   */
+  DataHeader & GetDataHeader ()
+  {
+    return m_dataHeader;
+  }
+  /**
+   * \returns the DataHeader
+   */
+  const DataHeader & GetDataHeader () const
+  {
+    return m_dataHeader;
+  }
+
+private:
+  uint32_t m_transportSize;                     ///< size of the transport header
+  uint8_t m_transport[MAX_TRANSPORT_SIZE];      ///< the transport header bytes
+  DataHeader m_dataHeader;                      ///< the DataHeader
+};
+
+/// Kind of a record in a control packet
+enum RecordType
+{
+  FULL_RECORD,          ///< MyprotocolHeader, its first byte is the high byte of x (x <= 1000)
+  DELTA_RECORD,         ///< DeltaHeader
+  KEYFRAME_REQUEST,     ///< KeyframeRequestHeader
+  LOCATION_REQUEST,     ///< LocationRequestHeader
+  LOCATION_REPLY        ///< LocationReplyHeader
+};
+
+/**
+ * \param firstByte the first byte of the record
+ * \returns the kind of the record
+ */
+RecordType GetRecordType (uint8_t firstByte);
+
+/**
+ * \ingroup myprotocol4
+ * \brief Position update encoded as changes against a keyframe of the same node.
+ *
+ * A keyframe is a full MyprotocolHeader the node sent before. Position,
+ * speed and timestamp are written as zigzag varints of their differences to
+ * the keyframe, so an update of a node moving steadily takes about 15 bytes
+ * instead of 28. The receiver needs the keyframe to decode it.
+ */
+class DeltaHeader : public Header
+{
+public:
+  DeltaHeader ();
+
+  static TypeId GetTypeId ();
+  TypeId GetInstanceTypeId () const;
+  uint32_t GetSerializedSize () const;
+  void Serialize (Buffer::Iterator start) const;
+  uint32_t Deserialize (Buffer::Iterator start);
+  void Print (std::ostream &os) const;
+
+  /**
+   * Encode an update against a keyframe of the same node.
+   * \param keyframe the keyframe
+   * \param update the update, its scope, uid and analysis mode are kept
+   */
+  void Encode (const MyprotocolHeader & keyframe, const MyprotocolHeader & update);
+  /**
+   * \param keyframe the keyframe whose timestamp is GetKeyframeTimestamp ()
+   * \returns the update
+   */
+  MyprotocolHeader Decode (const MyprotocolHeader & keyframe) const;
+
+  Ipv4Address GetMyadress () const
+  {
+    return m_myadress;
+  }
+  /**
+   * \returns the timestamp of the keyframe the update is encoded against
+   */
+  uint16_t GetKeyframeTimestamp () const
+  {
+    return m_keyframeTimestamp;
+  }
+  uint16_t GetTimestamp () const
+  {
+    return m_keyframeTimestamp + m_dt;
+  }
+  void SetUid (uint64_t uid)
+  {
+    m_uid = uid;
+  }
+  uint64_t GetUid () const
+  {
+    return m_uid;
+  }
+  /**
+   * \returns true if the uid is carried in an AnalysisTag instead of the header
+   */
+  bool IsAnalysisInTag () const
+  {
+    return m_analysisInTag;
+  }
+
+private:
+  uint8_t m_sign;               ///< velocity sign of the update
+  uint8_t m_scope;              ///< dissemination scope of the update
+  Ipv4Address m_myadress;       ///< the node
+  uint16_t m_keyframeTimestamp; ///< timestamp of the keyframe
+  int32_t m_dt;                 ///< timestamp difference
+  int32_t m_dx;                 ///< position differences
+  int32_t m_dy;
+  int32_t m_dz;
+  int32_t m_dvx;                ///< speed differences
+  int32_t m_dvy;
+  int32_t m_dvz;
+  uint64_t m_uid;
+  bool m_analysisInTag;
+};
+
+/**
+ * \ingroup myprotocol4
+ * \brief Asks a neighbor for the keyframe of a node, after a DeltaHeader
+ * that could not be decoded.
+ */
+class KeyframeRequestHeader : public Header
+{
+public:
+  /**
+   * \param myadress the node whose keyframe is missing
+   * \param timestamp the timestamp of the missing keyframe
+   */
+  KeyframeRequestHeader (Ipv4Address myadress = Ipv4Address (), uint16_t timestamp = 0);
+
+  static TypeId GetTypeId ();
+  TypeId GetInstanceTypeId () const;
+  uint32_t GetSerializedSize () const;
+  void Serialize (Buffer::Iterator start) const;
+  uint32_t Deserialize (Buffer::Iterator start);
+  void Print (std::ostream &os) const;
+
+  Ipv4Address GetMyadress () const
+  {
+    return m_myadress;
+  }
+  uint16_t GetTimestamp () const
+  {
+    return m_timestamp;
+  }
+
+private:
+  Ipv4Address m_myadress;       ///< the node whose keyframe is missing
+  uint16_t m_timestamp;         ///< timestamp of the keyframe
+};
+
+/**
+ * \ingroup myprotocol4
+ * \brief Asks for the position of a node, in the on-demand location mode.
+ *
+ * The request floods up to its TTL. It carries the position of the node
+ * that asks, so every node it reaches can route the reply there. The reply
+ * is a LocationReplyHeader, unicast to the asking node.
+ */
+class LocationRequestHeader : public Header
+{
+public:
+  /**
+   * \param target the node whose position is asked for
+   * \param id the request id, increasing per asking node
+   * \param ttl the number of hops the request may travel
+   * \param origin the last position update of the asking node
+   */
+  LocationRequestHeader (Ipv4Address target = Ipv4Address (), uint16_t id = 0, uint8_t ttl = 0,
+                         const MyprotocolHeader & origin = MyprotocolHeader ());
+
+  static TypeId GetTypeId ();
+  TypeId GetInstanceTypeId () const;
+  uint32_t GetSerializedSize () const;
+  void Serialize (Buffer::Iterator start) const;
+  uint32_t Deserialize (Buffer::Iterator start);
+  void Print (std::ostream &os) const;
+
+  Ipv4Address GetTarget () const
+  {
+    return m_target;
+  }
+  uint16_t GetId () const
+  {
+    return m_id;
+  }
+  void SetTtl (uint8_t ttl)
+  {
+    m_ttl = ttl;
+  }
+  uint8_t GetTtl () const
+  {
+    return m_ttl;
+  }
+  /**
+   * \returns the position update of the asking node, without uid and scope
+   */
+  const MyprotocolHeader & GetOrigin () const
+  {
+    return m_origin;
+  }
+
+private:
+  Ipv4Address m_target;         ///< the node whose position is asked for
+  uint16_t m_id;                ///< request id
+  uint8_t m_ttl;                ///< remaining hops
+  MyprotocolHeader m_origin;    ///< position update of the asking node
+};
+
+/**
+ * \ingroup myprotocol4
+ * \brief Position of the target of a location request, unicast to the asking node.
+ *
+ * Unlike a flooded MyprotocolHeader it is not subject to the duplicate
+ * check: the asking node may have heard the same report before and
+ * expired it since.
+ */
+class LocationReplyHeader : public Header
+{
+public:
+  /**
+   * \param record the position update of the target
+   */
+  LocationReplyHeader (const MyprotocolHeader & record = MyprotocolHeader ());
+
+  static TypeId GetTypeId ();
+  TypeId GetInstanceTypeId () const;
+  uint32_t GetSerializedSize () const;
+  void Serialize (Buffer::Iterator start) const;
+  uint32_t Deserialize (Buffer::Iterator start);
+  void Print (std::ostream &os) const;
+
+  /**
+   * \returns the position update of the target, without uid and scope
+   */
+  const MyprotocolHeader & GetRecord () const
+  {
+    return m_record;
+  }
+
+private:
+  MyprotocolHeader m_record;    ///< position update of the target
+};
+
+/**
+ * \ingroup myprotocol4
+ * \brief Simulation-only fields of the headers.
+ *
+ * The uid and the position error exist only for analysis. Carried in a tag
+ * they take no airtime, so the measured overhead is that of a deployable
+ * header. DataHeader uses it as a packet tag, MyprotocolHeader as a byte tag
+ * starting at its record, since a frame may aggregate several records.
+ */
+class AnalysisTag : public Tag
+{
+public:
+  AnalysisTag (uint64_t uid = 0, uint16_t error = 0);
+
+  static TypeId GetTypeId ();
+  TypeId GetInstanceTypeId () const;
+  uint32_t GetSerializedSize () const;
+  void Serialize (TagBuffer i) const;
+  void Deserialize (TagBuffer i);
+  void Print (std::ostream &os) const;
+
+  void SetUid (uint64_t uid)
+  {
+    m_uid = uid;
+  }
+  uint64_t GetUid () const
+  {
+    return m_uid;
+  }
+  void SetError (uint16_t error)
+  {
+    m_error = error;
+  }
+  uint16_t GetError () const
+  {
+    return m_error;
+  }
+
+private:
+  uint64_t m_uid;
+  uint16_t m_error;
+};
 }
 }
 
@@ -0,0 +1,83 @@
+#include "myprotocol4-position-store.h"
+
+namespace ns3 {
+namespace myprotocol4 {
+
+PositionStore::PositionStore ()
+{
+}
+
+Ptr<PositionStore>
+PositionStore::GetShared ()
+{
+  static Ptr<PositionStore> store = Create<PositionStore> ();
+  return store;
+}
+
+uint32_t
+PositionStore::Intern (const PositionRecord & record)
+{
+  std::unordered_map<PositionRecord, uint32_t, RecordHash>::iterator i = m_index.find (record);
+  if (i != m_index.end ())
+    {
+      m_refs[i->second]++;
+      return i->second;
+    }
+  uint32_t id;
+  if (m_free.empty ())
+    {
+      id = m_records.size ();
+      m_records.push_back (record);
+      m_refs.push_back (1);
+    }
+  else
+    {
+      id = m_free.back ();
+      m_free.pop_back ();
+      m_records[id] = record;
+      m_refs[id] = 1;
+    }
+  m_index[record] = id;
+  return id;
+}
+
+void
+PositionStore::Release (uint32_t id)
+{
+  if (--m_refs[id] == 0)
+    {
+      m_index.erase (m_records[id]);
+      m_free.push_back (id);
+    }
+}
+
+uint64_t
+PositionStore::GetMemoryUsage () const
+{
+  // 哈希表每个节点保存键值对、下一个节点的指针和缓存的哈希值
+  uint64_t node = sizeof (std::pair<const PositionRecord, uint32_t>) + 2 * sizeof (void *);
+  return m_records.capacity () * sizeof (PositionRecord)
+         + m_refs.capacity () * sizeof (uint32_t)
+         + m_free.capacity () * sizeof (uint32_t)
+         + m_index.bucket_count () * sizeof (void *)
+         + m_index.size () * node;
+}
+
+size_t
+PositionStore::RecordHash::operator() (const PositionRecord & r) const
+{
+  // 地址和时间戳基本决定了一条记录，运动参数只在同一秒多次报告时不同
+  uint64_t h = ((uint64_t) r.m_addr << 16) | r.m_timestamp;
+  h ^= ((uint64_t) r.m_x << 48) ^ ((uint64_t) r.m_y << 32) ^ ((uint64_t) r.m_z << 16);
+  h ^= ((uint64_t)(uint16_t) r.m_vx << 40) ^ ((uint64_t)(uint16_t) r.m_vy << 24) ^ (uint64_t)(uint16_t) r.m_vz;
+  // splitmix64的混合步骤
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+}
+}
@@ -0,0 +1,114 @@
+#ifndef MYPROTOCOL4_POSITION_STORE_H
+#define MYPROTOCOL4_POSITION_STORE_H
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include "ns3/simple-ref-count.h"
+#include "ns3/ptr.h"
+
+namespace ns3 {
+namespace myprotocol4 {
+
+/**
+ * \ingroup myprotocol4
+ * \brief A position report of a node as stored in the position tables.
+ */
+struct PositionRecord
+{
+  uint32_t m_addr;              ///< address of the node
+  uint16_t m_x;                 ///< position x
+  uint16_t m_y;                 ///< position y
+  uint16_t m_z;                 ///< position z
+  int16_t m_vx;                 ///< velocity x
+  int16_t m_vy;                 ///< velocity y
+  int16_t m_vz;                 ///< velocity z
+  uint16_t m_timestamp;         ///< second in which the position was valid
+
+  /**
+   * \param o the other record
+   * \returns true if all fields are equal
+   */
+  bool operator== (const PositionRecord & o) const
+  {
+    return m_addr == o.m_addr && m_timestamp == o.m_timestamp
+           && m_x == o.m_x && m_y == o.m_y && m_z == o.m_z
+           && m_vx == o.m_vx && m_vy == o.m_vy && m_vz == o.m_vz;
+  }
+};
+
+/**
+ * \ingroup myprotocol4
+ * \brief Reference-counted pool of distinct position records.
+ *
+ * With network-wide flooding every node learns the same report of an
+ * origin, so the position tables of all nodes hold nearly the same records.
+ * Tables sharing a store keep a 32-bit record id per entry instead of the
+ * record itself; a record is stored once for all tables holding it and is
+ * freed when the last of them replaces or drops it. Records are immutable,
+ * a table that learns a new report interns a new record, so every table
+ * still sees exactly the version it has learned.
+ */
+class PositionStore : public SimpleRefCount<PositionStore>
+{
+public:
+  PositionStore ();
+  /**
+   * \returns the store shared by all nodes of the simulation
+   */
+  static Ptr<PositionStore> GetShared ();
+  /**
+   * Look up a record, adding it if it is not stored yet, and take a reference on it.
+   * \param record the record
+   * \returns the id of the record
+   */
+  uint32_t Intern (const PositionRecord & record);
+  /**
+   * Drop a reference taken by Intern. The record is freed with its last reference.
+   * \param id the id of the record
+   */
+  void Release (uint32_t id);
+  /**
+   * \param id the id of a referenced record
+   * \returns the record
+   */
+  const PositionRecord & Get (uint32_t id) const
+  {
+    return m_records[id];
+  }
+  /**
+   * \returns the number of distinct records stored
+   */
+  uint32_t GetSize () const
+  {
+    return m_index.size ();
+  }
+  /**
+   * \returns the approximate number of bytes allocated by the store
+   */
+  uint64_t GetMemoryUsage () const;
+
+private:
+  /// Hash of all fields of a record
+  struct RecordHash
+  {
+    /**
+     * \param r the record
+     * \returns the hash value
+     */
+    size_t operator() (const PositionRecord & r) const;
+  };
+  /// id -> record, slots of freed records are reused
+  std::vector<PositionRecord> m_records;
+  /// id -> number of references, 0 for a free slot
+  std::vector<uint32_t> m_refs;
+  /// ids of the free slots
+  std::vector<uint32_t> m_free;
+  /// record -> id
+  std::unordered_map<PositionRecord, uint32_t, RecordHash> m_index;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,250 @@
+#include "myprotocol4-predict-kernel.h"
+
+#if (defined (__x86_64__) || defined (__i386__)) && defined (__GNUC__)
+#define MYPROTOCOL4_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace ns3 {
+namespace myprotocol4 {
+
+namespace {
+
+typedef void (*PredictFunction) (const KinematicArrays &, uint32_t, uint32_t, uint16_t,
+                                 uint16_t *, uint16_t *, uint16_t *);
+typedef uint32_t (*RangeFunction) (const uint16_t *, const uint16_t *, const uint16_t *, uint32_t, uint32_t,
+                                   Vector, double, uint32_t *, uint32_t);
+
+// 与RoutingTable::PredictPosition完全相同的16位运算（包括int16_t截断）
+inline uint16_t
+PredictAxis (uint16_t pos, int16_t vel, uint16_t deltaTime, uint16_t max)
+{
+  int16_t temp = pos + deltaTime * vel;
+  uint16_t p = temp > 0 ? temp : 0;
+  return p > max ? max : p;
+}
+
+void
+PredictScalar (const KinematicArrays & in, uint32_t begin, uint32_t end, uint16_t now,
+               uint16_t *px, uint16_t *py, uint16_t *pz)
+{
+  for (uint32_t i = begin; i < end; ++i)
+    {
+      uint16_t deltaTime = now - in.timestamp[i];
+      px[i] = PredictAxis (in.x[i], in.vx[i], deltaTime, PREDICT_MAX_X);
+      py[i] = PredictAxis (in.y[i], in.vy[i], deltaTime, PREDICT_MAX_Y);
+      pz[i] = PredictAxis (in.z[i], in.vz[i], deltaTime, PREDICT_MAX_Z);
+    }
+}
+
+uint32_t
+RangeScalar (const uint16_t *px, const uint16_t *py, const uint16_t *pz, uint32_t begin, uint32_t end,
+             Vector center, double range, uint32_t *out, uint32_t found)
+{
+  double range2 = range * range;
+  for (uint32_t i = begin; i < end; ++i)
+    {
+      double dx = px[i] - center.x;
+      double dy = py[i] - center.y;
+      double dz = pz[i] - center.z;
+      if (dx * dx + dy * dy + dz * dz <= range2)
+        {
+          out[found++] = i;
+        }
+    }
+  return found;
+}
+
+#ifdef MYPROTOCOL4_X86_KERNELS
+
+inline uint32_t
+EmitMask (uint32_t mask, uint32_t base, uint32_t *out, uint32_t found)
+{
+  while (mask)
+    {
+      out[found++] = base + __builtin_ctz (mask);
+      mask &= mask - 1;
+    }
+  return found;
+}
+
+// 有符号的16位max/min可以完成 >0 和 >max 两次截断，因为截断到0之后的值都不超过32767
+__attribute__ ((target ("sse4.1"))) void
+PredictSse41 (const KinematicArrays & in, uint32_t begin, uint32_t end, uint16_t now,
+              uint16_t *px, uint16_t *py, uint16_t *pz)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i vnow = _mm_set1_epi16 (now);
+  const __m128i maxX = _mm_set1_epi16 (PREDICT_MAX_X);
+  const __m128i maxY = _mm_set1_epi16 (PREDICT_MAX_Y);
+  const __m128i maxZ = _mm_set1_epi16 (PREDICT_MAX_Z);
+  uint32_t i = begin;
+  for (; i + 8 <= end; i += 8)
+    {
+      __m128i dt = _mm_sub_epi16 (vnow, _mm_loadu_si128 ((const __m128i *)(in.timestamp + i)));
+      __m128i x = _mm_add_epi16 (_mm_loadu_si128 ((const __m128i *)(in.x + i)),
+                                 _mm_mullo_epi16 (dt, _mm_loadu_si128 ((const __m128i *)(in.vx + i))));
+      __m128i y = _mm_add_epi16 (_mm_loadu_si128 ((const __m128i *)(in.y + i)),
+                                 _mm_mullo_epi16 (dt, _mm_loadu_si128 ((const __m128i *)(in.vy + i))));
+      __m128i z = _mm_add_epi16 (_mm_loadu_si128 ((const __m128i *)(in.z + i)),
+                                 _mm_mullo_epi16 (dt, _mm_loadu_si128 ((const __m128i *)(in.vz + i))));
+      _mm_storeu_si128 ((__m128i *)(px + i), _mm_min_epi16 (_mm_max_epi16 (x, zero), maxX));
+      _mm_storeu_si128 ((__m128i *)(py + i), _mm_min_epi16 (_mm_max_epi16 (y, zero), maxY));
+      _mm_storeu_si128 ((__m128i *)(pz + i), _mm_min_epi16 (_mm_max_epi16 (z, zero), maxZ));
+    }
+  PredictScalar (in, i, end, now, px, py, pz);
+}
+
+__attribute__ ((target ("sse4.1"))) inline __m128d
+SquaredDistanceSse41 (__m128i x, __m128i y, __m128i z, __m128d cx, __m128d cy, __m128d cz)
+{
+  __m128d dx = _mm_sub_pd (_mm_cvtepi32_pd (x), cx);
+  __m128d dy = _mm_sub_pd (_mm_cvtepi32_pd (y), cy);
+  __m128d dz = _mm_sub_pd (_mm_cvtepi32_pd (z), cz);
+  return _mm_add_pd (_mm_add_pd (_mm_mul_pd (dx, dx), _mm_mul_pd (dy, dy)), _mm_mul_pd (dz, dz));
+}
+
+__attribute__ ((target ("sse4.1"))) uint32_t
+RangeSse41 (const uint16_t *px, const uint16_t *py, const uint16_t *pz, uint32_t begin, uint32_t end,
+            Vector center, double range, uint32_t *out, uint32_t found)
+{
+  const __m128d cx = _mm_set1_pd (center.x);
+  const __m128d cy = _mm_set1_pd (center.y);
+  const __m128d cz = _mm_set1_pd (center.z);
+  const __m128d range2 = _mm_set1_pd (range * range);
+  uint32_t i = begin;
+  for (; i + 4 <= end; i += 4)
+    {
+      __m128i x = _mm_cvtepu16_epi32 (_mm_loadl_epi64 ((const __m128i *)(px + i)));
+      __m128i y = _mm_cvtepu16_epi32 (_mm_loadl_epi64 ((const __m128i *)(py + i)));
+      __m128i z = _mm_cvtepu16_epi32 (_mm_loadl_epi64 ((const __m128i *)(pz + i)));
+      __m128d lo = SquaredDistanceSse41 (x, y, z, cx, cy, cz);
+      __m128d hi = SquaredDistanceSse41 (_mm_unpackhi_epi64 (x, x), _mm_unpackhi_epi64 (y, y),
+                                         _mm_unpackhi_epi64 (z, z), cx, cy, cz);
+      uint32_t mask = _mm_movemask_pd (_mm_cmple_pd (lo, range2))
+        | (_mm_movemask_pd (_mm_cmple_pd (hi, range2)) << 2);
+      found = EmitMask (mask, i, out, found);
+    }
+  return RangeScalar (px, py, pz, i, end, center, range, out, found);
+}
+
+__attribute__ ((target ("avx2"))) void
+PredictAvx2 (const KinematicArrays & in, uint32_t begin, uint32_t end, uint16_t now,
+             uint16_t *px, uint16_t *py, uint16_t *pz)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  const __m256i vnow = _mm256_set1_epi16 (now);
+  const __m256i maxX = _mm256_set1_epi16 (PREDICT_MAX_X);
+  const __m256i maxY = _mm256_set1_epi16 (PREDICT_MAX_Y);
+  const __m256i maxZ = _mm256_set1_epi16 (PREDICT_MAX_Z);
+  uint32_t i = begin;
+  for (; i + 16 <= end; i += 16)
+    {
+      __m256i dt = _mm256_sub_epi16 (vnow, _mm256_loadu_si256 ((const __m256i *)(in.timestamp + i)));
+      __m256i x = _mm256_add_epi16 (_mm256_loadu_si256 ((const __m256i *)(in.x + i)),
+                                    _mm256_mullo_epi16 (dt, _mm256_loadu_si256 ((const __m256i *)(in.vx + i))));
+      __m256i y = _mm256_add_epi16 (_mm256_loadu_si256 ((const __m256i *)(in.y + i)),
+                                    _mm256_mullo_epi16 (dt, _mm256_loadu_si256 ((const __m256i *)(in.vy + i))));
+      __m256i z = _mm256_add_epi16 (_mm256_loadu_si256 ((const __m256i *)(in.z + i)),
+                                    _mm256_mullo_epi16 (dt, _mm256_loadu_si256 ((const __m256i *)(in.vz + i))));
+      _mm256_storeu_si256 ((__m256i *)(px + i), _mm256_min_epi16 (_mm256_max_epi16 (x, zero), maxX));
+      _mm256_storeu_si256 ((__m256i *)(py + i), _mm256_min_epi16 (_mm256_max_epi16 (y, zero), maxY));
+      _mm256_storeu_si256 ((__m256i *)(pz + i), _mm256_min_epi16 (_mm256_max_epi16 (z, zero), maxZ));
+    }
+  PredictSse41 (in, i, end, now, px, py, pz);
+}
+
+__attribute__ ((target ("avx2"))) inline __m256d
+SquaredDistanceAvx2 (__m128i x, __m128i y, __m128i z, __m256d cx, __m256d cy, __m256d cz)
+{
+  __m256d dx = _mm256_sub_pd (_mm256_cvtepi32_pd (x), cx);
+  __m256d dy = _mm256_sub_pd (_mm256_cvtepi32_pd (y), cy);
+  __m256d dz = _mm256_sub_pd (_mm256_cvtepi32_pd (z), cz);
+  return _mm256_add_pd (_mm256_add_pd (_mm256_mul_pd (dx, dx), _mm256_mul_pd (dy, dy)), _mm256_mul_pd (dz, dz));
+}
+
+__attribute__ ((target ("avx2"))) uint32_t
+RangeAvx2 (const uint16_t *px, const uint16_t *py, const uint16_t *pz, uint32_t begin, uint32_t end,
+           Vector center, double range, uint32_t *out, uint32_t found)
+{
+  const __m256d cx = _mm256_set1_pd (center.x);
+  const __m256d cy = _mm256_set1_pd (center.y);
+  const __m256d cz = _mm256_set1_pd (center.z);
+  const __m256d range2 = _mm256_set1_pd (range * range);
+  uint32_t i = begin;
+  for (; i + 8 <= end; i += 8)
+    {
+      __m256i x = _mm256_cvtepu16_epi32 (_mm_loadu_si128 ((const __m128i *)(px + i)));
+      __m256i y = _mm256_cvtepu16_epi32 (_mm_loadu_si128 ((const __m128i *)(py + i)));
+      __m256i z = _mm256_cvtepu16_epi32 (_mm_loadu_si128 ((const __m128i *)(pz + i)));
+      __m256d lo = SquaredDistanceAvx2 (_mm256_castsi256_si128 (x), _mm256_castsi256_si128 (y),
+                                        _mm256_castsi256_si128 (z), cx, cy, cz);
+      __m256d hi = SquaredDistanceAvx2 (_mm256_extracti128_si256 (x, 1), _mm256_extracti128_si256 (y, 1),
+                                        _mm256_extracti128_si256 (z, 1), cx, cy, cz);
+      uint32_t mask = _mm256_movemask_pd (_mm256_cmp_pd (lo, range2, _CMP_LE_OQ))
+        | (_mm256_movemask_pd (_mm256_cmp_pd (hi, range2, _CMP_LE_OQ)) << 4);
+      found = EmitMask (mask, i, out, found);
+    }
+  return RangeSse41 (px, py, pz, i, end, center, range, out, found);
+}
+
+#endif /* MYPROTOCOL4_X86_KERNELS */
+
+struct Kernels
+{
+  PredictFunction predict;
+  RangeFunction range;
+  const char *name;
+};
+
+Kernels
+SelectKernels ()
+{
+#ifdef MYPROTOCOL4_X86_KERNELS
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    {
+      Kernels k = { &PredictAvx2, &RangeAvx2, "avx2" };
+      return k;
+    }
+  if (__builtin_cpu_supports ("sse4.1"))
+    {
+      Kernels k = { &PredictSse41, &RangeSse41, "sse4.1" };
+      return k;
+    }
+#endif
+  Kernels k = { &PredictScalar, &RangeScalar, "scalar" };
+  return k;
+}
+
+const Kernels &
+GetKernels ()
+{
+  static const Kernels kernels = SelectKernels ();
+  return kernels;
+}
+
+}
+
+void
+PredictBatch (const KinematicArrays & in, uint32_t n, uint16_t now,
+              uint16_t *px, uint16_t *py, uint16_t *pz)
+{
+  GetKernels ().predict (in, 0, n, now, px, py, pz);
+}
+
+uint32_t
+WithinRangeBatch (const uint16_t *px, const uint16_t *py, const uint16_t *pz, uint32_t n,
+                  Vector center, double range, uint32_t *out)
+{
+  return GetKernels ().range (px, py, pz, 0, n, center, range, out, 0);
+}
+
+const char *
+GetPredictKernelName ()
+{
+  return GetKernels ().name;
+}
+
+}
+}
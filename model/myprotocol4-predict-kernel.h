@@ -0,0 +1,64 @@
+#ifndef MYPROTOCOL4_PREDICT_KERNEL_H
+#define MYPROTOCOL4_PREDICT_KERNEL_H
+
+#include <stdint.h>
+#include "ns3/vector.h"
+
+namespace ns3 {
+namespace myprotocol4 {
+
+/// Upper bounds of predicted positions, the simulation area is 1000*1000*300
+static const uint16_t PREDICT_MAX_X = 1000;
+static const uint16_t PREDICT_MAX_Y = 1000;
+static const uint16_t PREDICT_MAX_Z = 300;
+
+/**
+ * Read-only structure-of-arrays view of position table entries.
+ */
+struct KinematicArrays
+{
+  const uint16_t *x;            ///< position x
+  const uint16_t *y;            ///< position y
+  const uint16_t *z;            ///< position z
+  const int16_t *vx;            ///< velocity x
+  const int16_t *vy;            ///< velocity y
+  const int16_t *vz;            ///< velocity z
+  const uint16_t *timestamp;    ///< second in which the position was valid
+};
+
+/**
+ * Dead-reckon n entries to second now and clamp the result to the simulation
+ * area. The 16-bit arithmetic is identical to RoutingTable::PredictPosition.
+ * \param in the entries
+ * \param n the number of entries
+ * \param now the current simulation second
+ * \param px predicted x of each entry (output)
+ * \param py predicted y of each entry (output)
+ * \param pz predicted z of each entry (output)
+ */
+void PredictBatch (const KinematicArrays & in, uint32_t n, uint16_t now,
+                   uint16_t *px, uint16_t *py, uint16_t *pz);
+
+/**
+ * Compare the squared distance of n positions to center against range^2.
+ * \param px position x of each entry
+ * \param py position y of each entry
+ * \param pz position z of each entry
+ * \param n the number of entries
+ * \param center the reference position
+ * \param range the range in meters
+ * \param out indices of the entries within range, in increasing order (output, n elements at most)
+ * \returns the number of entries within range
+ */
+uint32_t WithinRangeBatch (const uint16_t *px, const uint16_t *py, const uint16_t *pz, uint32_t n,
+                           Vector center, double range, uint32_t *out);
+
+/**
+ * \returns the name of the kernel selected for this CPU: "avx2", "sse4.1" or "scalar"
+ */
+const char * GetPredictKernelName ();
+
+}
+}
+
+#endif
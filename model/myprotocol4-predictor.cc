@@ -0,0 +1,193 @@
+#include "myprotocol4-predictor.h"
+
+namespace ns3 {
+namespace myprotocol4 {
+
+/// Variance of a position truncated to whole meters
+static const double POSITION_NOISE = 1.0 / 12;
+/// Variance of a velocity truncated towards zero to whole meters per second
+static const double VELOCITY_NOISE = 1.0 / 3;
+
+MotionPredictor::~MotionPredictor ()
+{
+}
+
+bool
+MotionPredictor::IsConstantVelocity () const
+{
+  return false;
+}
+
+void
+ConstantVelocityPredictor::Observe (uint32_t addr, Vector pos, Vector vel, int64_t timestamp)
+{
+}
+
+Vector
+ConstantVelocityPredictor::Predict (uint32_t addr, Vector pos, Vector vel, int64_t timestamp, double now) const
+{
+  double dt = now - timestamp;
+  return Vector (pos.x + vel.x * dt, pos.y + vel.y * dt, pos.z + vel.z * dt);
+}
+
+void
+ConstantVelocityPredictor::Forget (uint32_t addr)
+{
+}
+
+void
+ConstantVelocityPredictor::Clear ()
+{
+}
+
+bool
+ConstantVelocityPredictor::IsConstantVelocity () const
+{
+  return true;
+}
+
+void
+ConstantAccelerationPredictor::Observe (uint32_t addr, Vector pos, Vector vel, int64_t timestamp)
+{
+  std::unordered_map<uint32_t, State>::iterator i = m_states.find (addr);
+  if (i == m_states.end ())
+    {
+      State s = { vel, Vector (0, 0, 0), timestamp };
+      m_states[addr] = s;
+      return;
+    }
+  State & s = i->second;
+  if (timestamp <= s.m_timestamp)
+    {
+      return;
+    }
+  double dt = timestamp - s.m_timestamp;
+  s.m_acc = Vector ((vel.x - s.m_vel.x) / dt, (vel.y - s.m_vel.y) / dt, (vel.z - s.m_vel.z) / dt);
+  s.m_vel = vel;
+  s.m_timestamp = timestamp;
+}
+
+Vector
+ConstantAccelerationPredictor::Predict (uint32_t addr, Vector pos, Vector vel, int64_t timestamp, double now) const
+{
+  double dt = now - timestamp;
+  Vector p (pos.x + vel.x * dt, pos.y + vel.y * dt, pos.z + vel.z * dt);
+  std::unordered_map<uint32_t, State>::const_iterator i = m_states.find (addr);
+  // 状态不是这次报告的（例如表项来自数据包头）时退化为匀速
+  if (i != m_states.end () && i->second.m_timestamp == timestamp)
+    {
+      const Vector & a = i->second.m_acc;
+      p.x += 0.5 * a.x * dt * dt;
+      p.y += 0.5 * a.y * dt * dt;
+      p.z += 0.5 * a.z * dt * dt;
+    }
+  return p;
+}
+
+void
+ConstantAccelerationPredictor::Forget (uint32_t addr)
+{
+  m_states.erase (addr);
+}
+
+void
+ConstantAccelerationPredictor::Clear ()
+{
+  m_states.clear ();
+}
+
+KalmanPredictor::KalmanPredictor (double processNoise)
+  : m_processNoise (processNoise)
+{
+}
+
+void
+KalmanPredictor::Axis::Init (double p, double v)
+{
+  m_p = p;
+  m_v = v;
+  m_pp = POSITION_NOISE;
+  m_pv = 0;
+  m_vv = VELOCITY_NOISE;
+}
+
+void
+KalmanPredictor::Axis::Update (double dt, double p, double v, double q)
+{
+  // 预测：x = F x，P = F P F' + Q，F = [1 dt; 0 1]，Q为白噪声加速度
+  double dt2 = dt * dt;
+  m_p += m_v * dt;
+  double pp = m_pp + 2 * dt * m_pv + dt2 * m_vv + q * dt2 * dt2 / 4;
+  double pv = m_pv + dt * m_vv + q * dt2 * dt / 2;
+  double vv = m_vv + q * dt2;
+
+  // 更新：位置和速度都被观测，H = I
+  double s00 = pp + POSITION_NOISE;
+  double s01 = pv;
+  double s11 = vv + VELOCITY_NOISE;
+  double det = s00 * s11 - s01 * s01;
+  double k00 = (pp * s11 - pv * s01) / det;
+  double k01 = (pv * s00 - pp * s01) / det;
+  double k10 = (pv * s11 - vv * s01) / det;
+  double k11 = (vv * s00 - pv * s01) / det;
+  double yp = p - m_p;
+  double yv = v - m_v;
+  m_p += k00 * yp + k01 * yv;
+  m_v += k10 * yp + k11 * yv;
+  m_pp = (1 - k00) * pp - k01 * pv;
+  m_pv = (1 - k00) * pv - k01 * vv;
+  m_vv = (1 - k11) * vv - k10 * pv;
+}
+
+void
+KalmanPredictor::Observe (uint32_t addr, Vector pos, Vector vel, int64_t timestamp)
+{
+  std::unordered_map<uint32_t, State>::iterator i = m_states.find (addr);
+  if (i == m_states.end ())
+    {
+      State & s = m_states[addr];
+      s.m_axis[0].Init (pos.x, vel.x);
+      s.m_axis[1].Init (pos.y, vel.y);
+      s.m_axis[2].Init (pos.z, vel.z);
+      s.m_timestamp = timestamp;
+      return;
+    }
+  State & s = i->second;
+  if (timestamp <= s.m_timestamp)
+    {
+      return;
+    }
+  double dt = timestamp - s.m_timestamp;
+  s.m_axis[0].Update (dt, pos.x, vel.x, m_processNoise);
+  s.m_axis[1].Update (dt, pos.y, vel.y, m_processNoise);
+  s.m_axis[2].Update (dt, pos.z, vel.z, m_processNoise);
+  s.m_timestamp = timestamp;
+}
+
+Vector
+KalmanPredictor::Predict (uint32_t addr, Vector pos, Vector vel, int64_t timestamp, double now) const
+{
+  double dt = now - timestamp;
+  std::unordered_map<uint32_t, State>::const_iterator i = m_states.find (addr);
+  if (i == m_states.end () || i->second.m_timestamp != timestamp)
+    {
+      return Vector (pos.x + vel.x * dt, pos.y + vel.y * dt, pos.z + vel.z * dt);
+    }
+  const Axis *a = i->second.m_axis;
+  return Vector (a[0].m_p + a[0].m_v * dt, a[1].m_p + a[1].m_v * dt, a[2].m_p + a[2].m_v * dt);
+}
+
+void
+KalmanPredictor::Forget (uint32_t addr)
+{
+  m_states.erase (addr);
+}
+
+void
+KalmanPredictor::Clear ()
+{
+  m_states.clear ();
+}
+
+}
+}
@@ -0,0 +1,156 @@
+#ifndef MYPROTOCOL4_PREDICTOR_H
+#define MYPROTOCOL4_PREDICTOR_H
+
+#include <stdint.h>
+#include <unordered_map>
+#include "ns3/simple-ref-count.h"
+#include "ns3/ptr.h"
+#include "ns3/vector.h"
+
+namespace ns3 {
+namespace myprotocol4 {
+
+/**
+ * \ingroup myprotocol4
+ * \brief Extrapolates the position of a node from the position reports it sent.
+ *
+ * Senders and receivers run the same predictor on the same sequence of
+ * reports, so the sender knows the trajectory its neighbors assume and can
+ * send the next update when the real one departs from it.
+ */
+class MotionPredictor : public SimpleRefCount<MotionPredictor>
+{
+public:
+  virtual ~MotionPredictor ();
+  /**
+   * Account a new position report of a node. Reports that are not newer
+   * than the last one of the node are ignored.
+   * \param addr the node
+   * \param pos the reported position
+   * \param vel the reported velocity
+   * \param timestamp the second in which the report was valid
+   */
+  virtual void Observe (uint32_t addr, Vector pos, Vector vel, int64_t timestamp) = 0;
+  /**
+   * Predict the position of a node from its last report.
+   * \param addr the node
+   * \param pos the reported position
+   * \param vel the reported velocity
+   * \param timestamp the second in which the report was valid
+   * \param now the time of the prediction in seconds
+   * \returns the predicted position, not limited to the simulation area
+   */
+  virtual Vector Predict (uint32_t addr, Vector pos, Vector vel, int64_t timestamp, double now) const = 0;
+  /**
+   * Drop the state kept for a node.
+   * \param addr the node
+   */
+  virtual void Forget (uint32_t addr) = 0;
+  /// Drop the state of all nodes
+  virtual void Clear () = 0;
+  /**
+   * \returns true if Predict is pos + vel * (now - timestamp), which the
+   *          batch kernels of the position table compute directly
+   */
+  virtual bool IsConstantVelocity () const;
+};
+
+/**
+ * \ingroup myprotocol4
+ * \brief Dead reckoning with the reported velocity, the behavior of the original protocol.
+ */
+class ConstantVelocityPredictor : public MotionPredictor
+{
+public:
+  virtual void Observe (uint32_t addr, Vector pos, Vector vel, int64_t timestamp);
+  virtual Vector Predict (uint32_t addr, Vector pos, Vector vel, int64_t timestamp, double now) const;
+  virtual void Forget (uint32_t addr);
+  virtual void Clear ();
+  virtual bool IsConstantVelocity () const;
+};
+
+/**
+ * \ingroup myprotocol4
+ * \brief Dead reckoning with the reported velocity and the acceleration
+ * between the last two reports of a node.
+ */
+class ConstantAccelerationPredictor : public MotionPredictor
+{
+public:
+  virtual void Observe (uint32_t addr, Vector pos, Vector vel, int64_t timestamp);
+  virtual Vector Predict (uint32_t addr, Vector pos, Vector vel, int64_t timestamp, double now) const;
+  virtual void Forget (uint32_t addr);
+  virtual void Clear ();
+
+private:
+  /// Motion state of one node
+  struct State
+  {
+    Vector m_vel;               ///< velocity of the last report
+    Vector m_acc;               ///< acceleration between the last two reports
+    int64_t m_timestamp;        ///< timestamp of the last report
+  };
+  /// node -> state
+  std::unordered_map<uint32_t, State> m_states;
+};
+
+/**
+ * \ingroup myprotocol4
+ * \brief Per-node Kalman filter with a constant-velocity model and white
+ * acceleration noise, one filter per axis.
+ *
+ * The reports carry truncated integer positions and velocities; the filter
+ * weighs them against the motion model, which mostly smooths the velocity.
+ */
+class KalmanPredictor : public MotionPredictor
+{
+public:
+  /**
+   * \param processNoise variance of the white acceleration noise in m^2/s^4
+   */
+  KalmanPredictor (double processNoise);
+  virtual void Observe (uint32_t addr, Vector pos, Vector vel, int64_t timestamp);
+  virtual Vector Predict (uint32_t addr, Vector pos, Vector vel, int64_t timestamp, double now) const;
+  virtual void Forget (uint32_t addr);
+  virtual void Clear ();
+
+private:
+  /// Filter state of one axis: estimate and symmetric covariance
+  struct Axis
+  {
+    /**
+     * Start the filter from a measurement.
+     * \param p the measured position
+     * \param v the measured velocity
+     */
+    void Init (double p, double v);
+    /**
+     * Propagate the estimate by dt seconds and correct it with a measurement.
+     * \param dt the time since the last measurement
+     * \param p the measured position
+     * \param v the measured velocity
+     * \param q the process noise
+     */
+    void Update (double dt, double p, double v, double q);
+
+    double m_p;         ///< position estimate
+    double m_v;         ///< velocity estimate
+    double m_pp;        ///< position variance
+    double m_pv;        ///< position-velocity covariance
+    double m_vv;        ///< velocity variance
+  };
+  /// Filter state of one node
+  struct State
+  {
+    Axis m_axis[3];             ///< x, y and z
+    int64_t m_timestamp;        ///< timestamp of the last report
+  };
+  double m_processNoise;        ///< variance of the acceleration noise
+  /// node -> state
+  std::unordered_map<uint32_t, State> m_states;
+};
+
+}
+}
+
+#endif
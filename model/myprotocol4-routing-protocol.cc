@@ -11,6 +11,10 @@
 #include "ns3/rng-seed-manager.h"
 #include "ns3/icmpv4.h"
 #include "ns3/udp-header.h"
+#include "ns3/icmpv4-l4-protocol.h"
+#include "ns3/udp-l4-protocol.h"
+#include "ns3/enum.h"
+#include <limits>
 
 namespace ns3 {
 
@@ -22,6 +26,25 @@ NS_OBJECT_ENSURE_REGISTERED (RoutingProtocol);
 
 /// UDP Port for myprotocol control traffic
 const uint32_t RoutingProtocol::MYPROTOCOL_PORT = 269;
+/// number of older keyframes kept per node besides the newest one
+static const uint32_t KEYFRAME_HISTORY = 4;
+
+// ADD：数据头前面传输层头的长度，由IP头中的协议号决定，不依赖PacketMetadata。
+// UDP和ICMP在RouteOutput之后才加传输层头，数据头在传输层头后面；
+// TCP在RouteOutput之前就加好了TCP头，数据头在最前面
+static uint32_t
+TransportHeaderSize (const Ipv4Header & header)
+{
+  if (header.GetProtocol () == UdpL4Protocol::PROT_NUMBER)
+    {
+      return UdpHeader ().GetSerializedSize ();
+    }
+  if (header.GetProtocol () == Icmpv4L4Protocol::PROT_NUMBER)
+    {
+      return Icmpv4Header ().GetSerializedSize ();
+    }
+  return 0;
+}
 
 class DeferredRouteOutputTag : public Tag
 {
@@ -99,10 +122,179 @@ RoutingProtocol::GetTypeId (void)
                    BooleanValue (false),
                    MakeBooleanAccessor (&RoutingProtocol::m_enableRecoveryMode),
                    MakeBooleanChecker ())   
+    .AddAttribute ("KinematicUpdateTrigger","Schedule position updates from the CourseChange trace at the time the advertised prediction drifts too far, instead of polling every CheckChangeInterval. ",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_kinematicTrigger),
+                   MakeBooleanChecker ())
+    .AddAttribute ("Predictor","Motion model used to predict positions, by the receivers of updates and by the sender to decide when to update. ",
+                   EnumValue (CONSTANT_VELOCITY),
+                   MakeEnumAccessor (&RoutingProtocol::m_predictorType),
+                   MakeEnumChecker (CONSTANT_VELOCITY, "ConstantVelocity",
+                                    CONSTANT_ACCELERATION, "ConstantAcceleration",
+                                    KALMAN, "Kalman"))
+    .AddAttribute ("KalmanProcessNoise","Variance of the white acceleration noise of the Kalman predictor, in m^2/s^4. ",
+                   DoubleValue (1.0),
+                   MakeDoubleAccessor (&RoutingProtocol::m_kalmanProcessNoise),
+                   MakeDoubleChecker<double> (0))
     .AddAttribute ("EnableQueue","Enables use queue. ",
                    BooleanValue (false),
                    MakeBooleanAccessor (&RoutingProtocol::m_enableQueue),
-                   MakeBooleanChecker ());         
+                   MakeBooleanChecker ())
+    .AddAttribute ("PurgeGranularity","Bucket width of the timing wheel that expires position entries, rounded to whole seconds. ",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&RoutingProtocol::m_purgeGranularity),
+                   MakeTimeChecker ())
+    .AddAttribute ("EntryErrorBudget","Position error in meters after which an entry expires, estimated as advertised speed times age. 0 keeps every entry MaxEntryLifeTime. ",
+                   DoubleValue (0),
+                   MakeDoubleAccessor (&RoutingProtocol::m_entryErrorBudget),
+                   MakeDoubleChecker<double> (0))
+    .AddAttribute ("MinEntryLifeTime","Shortest lifetime of a position entry, rounded down to whole seconds. ",
+                   TimeValue (Seconds (5)),
+                   MakeTimeAccessor (&RoutingProtocol::m_minEntryLifeTime),
+                   MakeTimeChecker ())
+    .AddAttribute ("MaxEntryLifeTime","Longest lifetime of a position entry, rounded down to whole seconds. ",
+                   TimeValue (Seconds (30)),
+                   MakeTimeAccessor (&RoutingProtocol::m_maxEntryLifeTime),
+                   MakeTimeChecker ())
+    .AddAttribute ("EnableIdCacheHighWaterMark","Detect duplicate updates with the newest timestamp of each origin instead of a time window. Updates older than the newest one are then always dropped, also after the window. ",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_enableIdCacheHighWaterMark),
+                   MakeBooleanChecker ())
+    .AddAttribute ("RebroadcastScheme","Scheme that decides whether a received position update is rebroadcast. ",
+                   EnumValue (BLIND_FLOODING),
+                   MakeEnumAccessor (&RoutingProtocol::m_rebroadcastScheme),
+                   MakeEnumChecker (BLIND_FLOODING, "Blind",
+                                    COUNTER_BASED, "Counter",
+                                    DISTANCE_BASED, "Distance",
+                                    GOSSIP, "Gossip"))
+    .AddAttribute ("RebroadcastDelay","Upper bound of the random assessment delay before a suppressible rebroadcast. ",
+                   TimeValue (MilliSeconds (10)),
+                   MakeTimeAccessor (&RoutingProtocol::m_rebroadcastDelay),
+                   MakeTimeChecker ())
+    .AddAttribute ("RebroadcastJitter","Upper bound of the random delay before a blind rebroadcast, zero to send immediately. ",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&RoutingProtocol::m_rebroadcastJitter),
+                   MakeTimeChecker ())
+    .AddAttribute ("EnableAggregation","Relay all pending position updates together, packed into as few frames as the MTU allows. ",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_enableAggregation),
+                   MakeBooleanChecker ())
+    .AddAttribute ("RebroadcastCounterThreshold","Counter-based scheme: suppress after hearing this many copies. ",
+                   UintegerValue (3),
+                   MakeUintegerAccessor (&RoutingProtocol::m_rebroadcastCounter),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("RebroadcastDistanceThreshold","Distance-based scheme: suppress if a copy came from a relay closer than this, in meters. ",
+                   DoubleValue (100),
+                   MakeDoubleAccessor (&RoutingProtocol::m_rebroadcastDistance),
+                   MakeDoubleChecker<double> (0))
+    .AddAttribute ("GossipProbability","Gossip scheme: probability to rebroadcast an update. ",
+                   DoubleValue (0.65),
+                   MakeDoubleAccessor (&RoutingProtocol::m_gossipProbability),
+                   MakeDoubleChecker<double> (0, 1))
+    .AddAttribute ("EnableDistanceEffect","Limit most position updates to LocalUpdateScope hops and flood one every GlobalUpdateInterval. ",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_enableDistanceEffect),
+                   MakeBooleanChecker ())
+    .AddAttribute ("LocalUpdateScope","Number of hops a local position update travels when the distance effect is enabled. ",
+                   UintegerValue (2),
+                   MakeUintegerAccessor (&RoutingProtocol::m_localUpdateScope),
+                   MakeUintegerChecker<uint32_t> (1, 255))
+    .AddAttribute ("GlobalUpdateInterval","Minimum interval between network-wide position updates when the distance effect is enabled. ",
+                   TimeValue (Seconds (10)),
+                   MakeTimeAccessor (&RoutingProtocol::m_globalUpdateInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("CompactDataHeader","Originate data packets with the compact variable-length DataHeader encoding. ",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_compactDataHeader),
+                   MakeBooleanChecker ())
+    .AddAttribute ("AnalysisFieldsInTags","Carry the simulation-only uid and error fields in packet tags instead of the headers. ",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_analysisInTags),
+                   MakeBooleanChecker ())
+    .AddAttribute ("DeltaBeacons","Send position updates as changes against the last keyframe of the node. All nodes must use the same setting. ",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_deltaBeacons),
+                   MakeBooleanChecker ())
+    .AddAttribute ("KeyframeInterval","Number of delta position updates between two full keyframes. ",
+                   UintegerValue (5),
+                   MakeUintegerAccessor (&RoutingProtocol::m_keyframeInterval),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("AdaptiveRate","Scale the update threshold and the maximum update interval with the neighbor density and the control load. ",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_adaptiveRate),
+                   MakeBooleanChecker ())
+    .AddAttribute ("TargetNeighbors","Number of neighbors heard per second at which the update rate is not scaled. ",
+                   UintegerValue (10),
+                   MakeUintegerAccessor (&RoutingProtocol::m_targetNeighbors),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("TargetControlLoad","Number of position update records received per second at which the update rate is not scaled. ",
+                   DoubleValue (50),
+                   MakeDoubleAccessor (&RoutingProtocol::m_targetControlLoad),
+                   MakeDoubleChecker<double> (0))
+    .AddAttribute ("MinRateScale","Lower bound of the factor on the update threshold and the maximum update interval, used in sparse regions. ",
+                   DoubleValue (0.5),
+                   MakeDoubleAccessor (&RoutingProtocol::m_minRateScale),
+                   MakeDoubleChecker<double> (0))
+    .AddAttribute ("MaxRateScale","Upper bound of the factor on the update threshold and the maximum update interval, used in dense regions. The interval stays below MaxEntryLifeTime. ",
+                   DoubleValue (4),
+                   MakeDoubleAccessor (&RoutingProtocol::m_maxRateScale),
+                   MakeDoubleChecker<double> (0))
+    .AddAttribute ("OnDemandLocation","Send position updates to one-hop neighbors only and look up other destinations with location requests. Needs EnableQueue. All nodes must use the same setting. ",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_onDemandLocation),
+                   MakeBooleanChecker ())
+    .AddAttribute ("LocationRequestTtlStart","TTL of the first location request of an expanding ring search. ",
+                   UintegerValue (2),
+                   MakeUintegerAccessor (&RoutingProtocol::m_locationTtlStart),
+                   MakeUintegerChecker<uint32_t> (1, 255))
+    .AddAttribute ("LocationRequestTtlIncrement","TTL increment of each retry of a location request. ",
+                   UintegerValue (2),
+                   MakeUintegerAccessor (&RoutingProtocol::m_locationTtlIncrement),
+                   MakeUintegerChecker<uint32_t> (1, 255))
+    .AddAttribute ("LocationRequestTtlThreshold","Largest TTL of the expanding ring, the next retry is network-wide. ",
+                   UintegerValue (7),
+                   MakeUintegerAccessor (&RoutingProtocol::m_locationTtlThreshold),
+                   MakeUintegerChecker<uint32_t> (1, 255))
+    .AddAttribute ("SharedPositionStore","Keep the position reports of all nodes in one store of the simulation, each position table only references the reports it has learned. ",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_sharedPositionStore),
+                   MakeBooleanChecker ())
+    .AddTraceSource ("RebroadcastsSent", "Number of position updates rebroadcast.",
+                     MakeTraceSourceAccessor (&RoutingProtocol::m_rebroadcastsSent),
+                     "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("RebroadcastsSuppressed", "Number of position updates not rebroadcast by the suppression scheme.",
+                     MakeTraceSourceAccessor (&RoutingProtocol::m_rebroadcastsSuppressed),
+                     "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("CoalescedUpdates", "Number of pending rebroadcasts replaced by a newer update of the same origin.",
+                     MakeTraceSourceAccessor (&RoutingProtocol::m_coalescedUpdates),
+                     "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("NextHopCacheHits", "Number of forwarded packets that reused a cached next hop decision.",
+                     MakeTraceSourceAccessor (&RoutingProtocol::m_nextHopCacheHits),
+                     "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("NextHopCacheMisses", "Number of forwarded packets that computed the next hop decision.",
+                     MakeTraceSourceAccessor (&RoutingProtocol::m_nextHopCacheMisses),
+                     "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("DataHeaderRewrites", "Number of transport and data headers replaced in one step, each saving a buffer reallocation.",
+                     MakeTraceSourceAccessor (&RoutingProtocol::m_dataHeaderRewrites),
+                     "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("DropsWithoutCopy", "Number of data packets dropped on the peeked headers, without copying the packet.",
+                     MakeTraceSourceAccessor (&RoutingProtocol::m_dropsWithoutCopy),
+                     "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("DeltaUpdatesSent", "Number of position updates sent or relayed as deltas against a keyframe.",
+                     MakeTraceSourceAccessor (&RoutingProtocol::m_deltaUpdatesSent),
+                     "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("KeyframeMisses", "Number of received delta position updates whose keyframe was missing.",
+                     MakeTraceSourceAccessor (&RoutingProtocol::m_keyframeMisses),
+                     "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("RateScale", "Factor on the update threshold and the maximum update interval chosen by the adaptive rate controller.",
+                     MakeTraceSourceAccessor (&RoutingProtocol::m_rateScale),
+                     "ns3::TracedValueCallback::Double")
+    .AddTraceSource ("LocationRequestsSent", "Number of location requests originated, retries included.",
+                     MakeTraceSourceAccessor (&RoutingProtocol::m_locationRequestsSent),
+                     "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("LocationRepliesSent", "Number of location replies sent.",
+                     MakeTraceSourceAccessor (&RoutingProtocol::m_locationRepliesSent),
+                     "ns3::TracedValueCallback::Uint32");
   return tid;
 }
 
@@ -124,6 +316,8 @@ RoutingProtocol::RoutingProtocol ()
     m_lastSendTime(0),
     m_lastSendPos(Vector(0,0,0)),
     m_lastSendVelocity(Vector(0,0,0)),
+    m_lastReportPos(Vector(0,0,0)),
+    m_lastReportVelocity(Vector(0,0,0)),
     m_maxIntervalTime(20),
     m_idCache(m_pathDiscoveryTime),            // 每个生命周期是2.4s
     m_maxQueueLen (64),
@@ -131,9 +325,30 @@ RoutingProtocol::RoutingProtocol ()
     m_queue (m_maxQueueLen, m_maxQueueTime),
     m_transRange(250),
     m_scaleFactor(1.5),
+    m_nextHopCacheTime (-1),
+    m_nextHopCacheHits (0),
+    m_nextHopCacheMisses (0),
+    m_dataHeaderRewrites (0),
+    m_dropsWithoutCopy (0),
+    m_rebroadcastsSent (0),
+    m_rebroadcastsSuppressed (0),
+    m_coalescedUpdates (0),
+    m_lastGlobalUpdateTime (-1),
+    m_updatesSinceKeyframe (0),
+    m_deltaUpdatesSent (0),
+    m_keyframeMisses (0),
+    m_receivedRecords (0),
+    m_neighborEstimate (0),
+    m_controlLoad (0),
+    m_rateScale (1),
+    m_locationRequestId (0),
+    m_locationIdCache (m_pathDiscoveryTime),
+    m_locationRequestsSent (0),
+    m_locationRepliesSent (0),
     m_checkChangeTimer(Timer::CANCEL_ON_DESTROY)
 {
   m_uniformRandomVariable = CreateObject<UniformRandomVariable> ();
+  m_routingTable.SetTransRange (m_transRange);
   // ADD：初始化位置服务
   m_locationService = CreateObject<GodLocationService> ();
 }
@@ -145,6 +360,25 @@ RoutingProtocol::~RoutingProtocol ()
 void
 RoutingProtocol::DoDispose ()
 {
+  for (std::map<Ipv4Address, PendingRebroadcast>::iterator i = m_pendingRebroadcast.begin ();
+       i != m_pendingRebroadcast.end (); ++i)
+    {
+      i->second.m_event.Cancel ();
+    }
+  m_pendingRebroadcast.clear ();
+  m_aggregationEvent.Cancel ();
+  m_rateControlEvent.Cancel ();
+  for (std::map<Ipv4Address, LocationQuery>::iterator i = m_locationQueries.begin ();
+       i != m_locationQueries.end (); ++i)
+    {
+      i->second.m_timeout.Cancel ();
+    }
+  m_locationQueries.clear ();
+  if (m_kinematicTrigger && m_ipv4 != 0)
+    {
+      Ptr<MobilityModel> mobility = m_ipv4->GetObject<MobilityModel> ();
+      mobility->TraceDisconnectWithoutContext ("CourseChange", MakeCallback (&RoutingProtocol::CourseChanged, this));
+    }
   m_ipv4 = 0;
   for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::iterator iter = m_socketAddresses.begin (); iter
        != m_socketAddresses.end (); iter++)
@@ -152,6 +386,11 @@ RoutingProtocol::DoDispose ()
       iter->first->Close ();
     }
   m_socketAddresses.clear ();
+  if (m_replySocket != 0)
+    {
+      m_replySocket->Close ();
+      m_replySocket = 0;
+    }
   Ipv4RoutingProtocol::DoDispose ();
 }
 
@@ -172,7 +411,36 @@ RoutingProtocol::Start ()
 {
   m_scb = MakeCallback (&RoutingProtocol::Send,this);
   m_ecb = MakeCallback (&RoutingProtocol::Drop,this);
+  m_routingTable.SetPurgeGranularity (m_purgeGranularity.ToInteger (Time::S));
+  m_routingTable.SetEntryLifeTime (m_entryErrorBudget, m_minEntryLifeTime.ToInteger (Time::S), m_maxEntryLifeTime.ToInteger (Time::S));
+  m_idCache.SetHighWaterMark (m_enableIdCacheHighWaterMark);
+  m_locationIdCache.SetHighWaterMark (m_enableIdCacheHighWaterMark);
+  m_routingTable.SetPredictor (CreatePredictor ());
+  if (m_sharedPositionStore)
+    {
+      m_routingTable.SetPositionStore (PositionStore::GetShared ());
+    }
+  m_selfPredictor = CreatePredictor ();
+  if (m_onDemandLocation)
+    {
+      // 回复可能要经过多跳，控制包的套接字TTL为1，并且绑定在接口上，回复改用单独的套接字由RouteOutput贪婪转发
+      m_replySocket = Socket::CreateSocket (GetObject<Node> (), UdpSocketFactory::GetTypeId ());
+      m_replySocket->Bind ();
+      m_replySocket->SetAttribute ("IpTtl", UintegerValue (m_netDiameter));
+    }
+  if (m_adaptiveRate)
+    {
+      m_rateControlEvent = Simulator::Schedule (Seconds (1), &RoutingProtocol::UpdateRateScale, this);
+    }
   SendUpdate();
+  if (m_kinematicTrigger)
+    {
+      Ptr<MobilityModel> mobility = m_ipv4->GetObject<MobilityModel> ();
+      mobility->TraceConnectWithoutContext ("CourseChange", MakeCallback (&RoutingProtocol::CourseChanged, this));
+      m_checkChangeTimer.SetFunction (&RoutingProtocol::KinematicCheck, this);
+      ScheduleKinematicCheck ();
+      return;
+    }
   m_checkChangeTimer.SetFunction (&RoutingProtocol::CheckChange,this);
   m_checkChangeTimer.Schedule (MilliSeconds (m_uniformRandomVariable->GetInteger (1000,2000)));
 
@@ -187,13 +455,9 @@ RoutingProtocol::RouteOutput (Ptr<Packet> p,
 {
   NS_LOG_FUNCTION (this << header << (oif ? oif->GetIfIndex () : 0));
 
+  // TCP建立连接时用空的数据包查询源地址，没有数据包可以加标签
   if (!p)
     {
-      DeferredRouteOutputTag tag (0);
-      if (!p->PeekPacketTag (tag))
-        {
-          p->AddPacketTag (tag);
-        }
       return LoopbackRoute (header,oif);
     }
   if (m_socketAddresses.empty ())
@@ -218,6 +482,8 @@ RoutingProtocol::RouteOutput (Ptr<Packet> p,
   }else{
     // 目的地是单播，则是一个数据包，需要添加贪婪转发状态的包头，再进行贪婪转发。
     DataHeader dataHeader;
+    dataHeader.SetCompact(m_compactDataHeader);
+    dataHeader.SetAnalysisInTag(m_analysisInTags);
     dataHeader.SetDstPosx(0);
     dataHeader.SetDstPosy(0);
     dataHeader.SetDstPosz(0);
@@ -250,8 +516,6 @@ RoutingProtocol::RouteOutput (Ptr<Packet> p,
 
       Ptr<MobilityModel> MM = m_ipv4->GetObject<MobilityModel> ();
       Vector myPos = MM->GetPosition();
-      std::map<Ipv4Address, RoutingTableEntry> neighborTable;
-      m_routingTable.LookupNeighbor(neighborTable, myPos);
 
       // 有邻居也有目的地的位置，则一定可以找到转发出去的下一跳
       Vector dstPos = m_routingTable.PredictPosition(dst);
@@ -260,9 +524,12 @@ RoutingProtocol::RouteOutput (Ptr<Packet> p,
       uint16_t error = CalculateDistance(dstPos, realDstPos);
       dataHeader.SetError(error);
 
+      Ipv4Address nexthop;
+      uint32_t neighborCount = m_routingTable.LookupNextHop(myPos, dstPos, nexthop);
+
       // 有目的地，但是没有邻居,丢弃
-      if(neighborTable.size() == 0){
-        p->AddHeader(dataHeader);
+      if(neighborCount == 0){
+        AddDataHeader(p, dataHeader);
         // 没有目的地的地址/没有邻居
         DeferredRouteOutputTag tag (0);
         if (!p->PeekPacketTag (tag))
@@ -272,10 +539,9 @@ RoutingProtocol::RouteOutput (Ptr<Packet> p,
         return LoopbackRoute (header,oif);
       }
 
-      Ipv4Address nexthop = m_routingTable.BestNeighbor(neighborTable, dstPos, myPos);
       // 数据包找到了合适的下一跳
       if(nexthop != Ipv4Address::GetZero ()){
-        p->AddHeader(dataHeader);
+        AddDataHeader(p, dataHeader);
         route->SetDestination(dst);
         route->SetGateway(nexthop);
         route->SetSource (m_ipv4->GetAddress (1, 0).GetLocal ());
@@ -288,8 +554,10 @@ RoutingProtocol::RouteOutput (Ptr<Packet> p,
           dataHeader.SetRecPosy((uint16_t)myPos.y);
           dataHeader.SetRecPosz((uint16_t)myPos.z);
           dataHeader.SetInRec(1);
-          p->AddHeader(dataHeader);
+          AddDataHeader(p, dataHeader);
           // 恢复模式获得下一跳
+          std::map<Ipv4Address, RoutingTableEntry> neighborTable;
+          m_routingTable.LookupNeighbor(neighborTable, myPos);
           nexthop = RecoveryMode (neighborTable);
           Ptr<Ipv4Route> route = Create<Ipv4Route> ();
           route->SetDestination (dst);
@@ -298,7 +566,7 @@ RoutingProtocol::RouteOutput (Ptr<Packet> p,
           route->SetOutputDevice (m_ipv4->GetNetDevice (1));  
           return route;
         }else{
-          p->AddHeader(dataHeader);
+          AddDataHeader(p, dataHeader);
           DeferredRouteOutputTag tag (0);
           if (!p->PeekPacketTag (tag))
             {
@@ -308,7 +576,7 @@ RoutingProtocol::RouteOutput (Ptr<Packet> p,
         }
       }
     }else{
-      p->AddHeader(dataHeader);
+      AddDataHeader(p, dataHeader);
       // 没有目的地的地址
       DeferredRouteOutputTag tag (1);
       if (!p->PeekPacketTag (tag))
@@ -429,8 +697,7 @@ RoutingProtocol::RouteInput (Ptr<const Packet> p,
       Ptr<Packet> packet = p->Copy ();
       if (lcb.IsNull () == false)
         {
-          DataHeader dataHeader;
-          packet->RemoveHeader(dataHeader);
+          StripDataHeader (packet, header);
           NS_LOG_LOGIC ("Unicast local delivery to " << dst);
           lcb (packet, header, iif);
         }
@@ -462,32 +729,25 @@ RoutingProtocol::DeferredRouteOutput (Ptr<const Packet> p, const Ipv4Header & he
 
   QueueEntry newEntry (p, header, ucb, ecb);
   m_queue.Enqueue (newEntry);
+  // ADD：按需位置服务，查询目的地的位置，回复到达时发送队列中的数据包
+  if (m_onDemandLocation)
+    {
+      RequestLocation (header.GetDestination ());
+    }
 }
 
 /// ADD：If route exists and valid, forward packet.
 bool 
 RoutingProtocol::Forwarding (Ptr<const Packet> packet, const Ipv4Header & header, UnicastForwardCallback ucb, ErrorCallback ecb){
-  PacketMetadata::ItemIterator i = packet->BeginItem();
-  PacketMetadata::Item item = i.Next ();
-  TypeId id = item.tid;
-  Ptr<Packet> p = packet->Copy ();
-  Icmpv4Header icmpv4Header;
-  UdpHeader udpHeader;
-  
-  // icmpv4的包
-  if(id == icmpv4Header.GetTypeId()){
-    std::cout<<"this is not udp packet!!!\n";
-    p->RemoveHeader(icmpv4Header);
-  }else{
-    p->RemoveHeader(udpHeader);
-  }
-  
-  DataHeader dataHeader;
-  p->RemoveHeader(dataHeader);
+  // ADD：先只读出传输层头和数据头，确定转发之后才复制数据包，并一次替换这两个头
+  DataHeaderView view (TransportHeaderSize (header));
+  uint32_t viewSize = PeekDataHeader (packet, view);
+  DataHeader & dataHeader = view.GetDataHeader ();
 
   uint16_t hop = dataHeader.GetHop();
   // 如果转发跳数超过10，很有可能出现了循环（预测与实际不符），直接丢弃。
   if(hop >= 10){
+    m_dropsWithoutCopy++;
     return false;
   }
 
@@ -551,9 +811,6 @@ RoutingProtocol::Forwarding (Ptr<const Packet> packet, const Ipv4Header & header
   Ptr<MobilityModel> MM = m_ipv4->GetObject<MobilityModel> ();
   Vector myPos = MM->GetPosition();
 
-  std::map<Ipv4Address, RoutingTableEntry> neighborTable;
-  m_routingTable.LookupNeighbor(neighborTable, myPos);
-
   // 预测目的地现在的位置
   Vector predictDst = m_routingTable.PredictPosition(dst);
   // 计算位置准确度
@@ -561,8 +818,12 @@ RoutingProtocol::Forwarding (Ptr<const Packet> packet, const Ipv4Header & header
   uint16_t error = CalculateDistance(predictDst, realDstPos);
   dataHeader.SetError(error);
 
+  Ipv4Address nextHop;
+  uint32_t neighborCount = LookupNextHopCached (dst, DstTimestamp, myPos, predictDst, nextHop);
+
   // 没有邻居转发，丢弃
-  if(neighborTable.size() == 0){
+  if(neighborCount == 0){
+    m_dropsWithoutCopy++;
     return false;
   }
    
@@ -575,16 +836,11 @@ RoutingProtocol::Forwarding (Ptr<const Packet> packet, const Ipv4Header & header
   }
 
   if(inRec == 0){
-    Ipv4Address nextHop = m_routingTable.BestNeighbor (neighborTable, predictDst, myPos);
     if (nextHop != Ipv4Address::GetZero ())
     {
       dataHeader.SetHop(dataHeader.GetHop() + 1);
-      p->AddHeader (dataHeader);  
-      if(id == icmpv4Header.GetTypeId()){
-        p->AddHeader(icmpv4Header);
-      }else{
-        p->AddHeader(udpHeader);
-      }        
+      Ptr<Packet> p = packet->Copy ();
+      RewriteDataHeader (p, viewSize, view);
       Ptr<Ipv4Route> route = Create<Ipv4Route> ();
       route->SetDestination (dst);
       route->SetSource (header.GetSource ());
@@ -605,14 +861,12 @@ RoutingProtocol::Forwarding (Ptr<const Packet> packet, const Ipv4Header & header
   if(inRec == 1){
     if(m_enableRecoveryMode){
       dataHeader.SetHop(dataHeader.GetHop() + 1);
-      p->AddHeader (dataHeader);
-      if(id == icmpv4Header.GetTypeId()){
-        p->AddHeader(icmpv4Header);
-      }else{
-        p->AddHeader(udpHeader);
-      }
+      Ptr<Packet> p = packet->Copy ();
+      RewriteDataHeader (p, viewSize, view);
       // 恢复模式
-      Ipv4Address nextHop = RecoveryMode (neighborTable);
+      std::map<Ipv4Address, RoutingTableEntry> neighborTable;
+      m_routingTable.LookupNeighbor(neighborTable, myPos);
+      nextHop = RecoveryMode (neighborTable);
       Ptr<Ipv4Route> route = Create<Ipv4Route> ();
       route->SetDestination (dst);
       route->SetSource (header.GetSource ());
@@ -621,6 +875,7 @@ RoutingProtocol::Forwarding (Ptr<const Packet> packet, const Ipv4Header & header
       ucb (route, p, header); 
       return true;
     }else{
+      m_dropsWithoutCopy++;
       return false;
     }
   }
@@ -628,6 +883,327 @@ RoutingProtocol::Forwarding (Ptr<const Packet> packet, const Ipv4Header & header
   return false;
 }
 
+void
+RoutingProtocol::BroadcastUpdate (const MyprotocolHeader & header)
+{
+  BroadcastUpdates (std::vector<MyprotocolHeader> (1, header));
+}
+
+void
+RoutingProtocol::BroadcastUpdates (const std::vector<MyprotocolHeader> & headers)
+{
+  MyprotocolHeader record;
+  record.SetAnalysisInTag (m_analysisInTags);
+  uint32_t recordSize = record.GetSerializedSize ();
+  for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator j = m_socketAddresses.begin (); j
+       != m_socketAddresses.end (); ++j)
+  {
+    Ptr<Socket> socket = j->first;
+    Ipv4InterfaceAddress iface = j->second;
+    Ipv4Address destination;
+    if (iface.GetMask () == Ipv4Mask::GetOnes ())
+      {
+        destination = Ipv4Address ("255.255.255.255");
+      }
+    else
+      {
+        destination = iface.GetBroadcast ();
+      }
+    // 每个帧中放入尽可能多的记录，但不超过接口的MTU（扣除IP头和UDP头）
+    uint32_t mtu = m_ipv4->GetMtu (m_ipv4->GetInterfaceForAddress (iface.GetLocal ()));
+    uint32_t perFrame = mtu > 28 + recordSize ? (mtu - 28) / recordSize : 1;
+    for (uint32_t first = 0; first < headers.size (); first += perFrame)
+      {
+        Ptr<Packet> p = Create<Packet> ();
+        uint32_t last = std::min<uint32_t> (first + perFrame, headers.size ());
+        // AddHeader加在最前面，倒序添加使接收端按原顺序解析
+        for (uint32_t k = last; k > first; --k)
+          {
+            AddUpdateRecord (p, headers[k - 1]);
+          }
+        socket->SendTo (p, 0, InetSocketAddress (destination, MYPROTOCOL_PORT));
+      }
+  }
+}
+
+void
+RoutingProtocol::AddUpdateRecord (Ptr<Packet> packet, MyprotocolHeader header)
+{
+  header.SetAnalysisInTag (m_analysisInTags);
+  // ADD：差分更新。关键帧本身、没有关键帧或者变化太大时发送完整的记录
+  DeltaHeader delta;
+  bool useDelta = false;
+  if (m_deltaBeacons)
+    {
+      std::map<Ipv4Address, MyprotocolHeader>::const_iterator keyframe = m_keyframes.find (header.GetMyadress ());
+      if (keyframe != m_keyframes.end () && keyframe->second.GetTimestamp () != header.GetTimestamp ())
+        {
+          delta.Encode (keyframe->second, header);
+          useDelta = delta.GetSerializedSize () < header.GetSerializedSize ();
+        }
+    }
+  if (useDelta)
+    {
+      packet->AddHeader (delta);
+      m_deltaUpdatesSent++;
+    }
+  else
+    {
+      packet->AddHeader (header);
+    }
+  if (m_analysisInTags)
+    {
+      // 字节tag覆盖当前整个包，起点就是这条记录的起点，接收端按起点找回每条记录的uid
+      packet->AddByteTag (AnalysisTag (header.GetUid ()));
+    }
+}
+
+void
+RoutingProtocol::AddDataHeader (Ptr<Packet> packet, const DataHeader & dataHeader)
+{
+  UpdateAnalysisTag (packet, dataHeader);
+  packet->AddHeader (dataHeader);
+}
+
+void
+RoutingProtocol::RemoveDataHeader (Ptr<Packet> packet, DataHeader & dataHeader)
+{
+  packet->RemoveHeader (dataHeader);
+  RestoreAnalysisFields (packet, dataHeader);
+}
+
+void
+RoutingProtocol::StripDataHeader (Ptr<Packet> packet, const Ipv4Header & header)
+{
+  DataHeader dataHeader;
+  if (header.GetProtocol () == UdpL4Protocol::PROT_NUMBER)
+    {
+      // UDP头中的长度包含了数据头，去掉数据头后要修正
+      UdpHeader udpHeader;
+      packet->RemoveHeader (udpHeader);
+      RemoveDataHeader (packet, dataHeader);
+      udpHeader.ForcePayloadSize (packet->GetSize ());
+      packet->AddHeader (udpHeader);
+    }
+  else if (header.GetProtocol () == Icmpv4L4Protocol::PROT_NUMBER)
+    {
+      Icmpv4Header icmpv4Header;
+      packet->RemoveHeader (icmpv4Header);
+      RemoveDataHeader (packet, dataHeader);
+      packet->AddHeader (icmpv4Header);
+    }
+  else
+    {
+      RemoveDataHeader (packet, dataHeader);
+    }
+}
+
+uint32_t
+RoutingProtocol::PeekDataHeader (Ptr<const Packet> packet, DataHeaderView & view)
+{
+  uint32_t size = packet->PeekHeader (view);
+  RestoreAnalysisFields (packet, view.GetDataHeader ());
+  return size;
+}
+
+// ADD：只在包头的位置替换传输层头和数据头，载荷不动。
+// 原来先删除再逐个添加两个头，共享的缓冲区每添加一个头都要重新分配并复制整个包，现在只需要一次
+void
+RoutingProtocol::RewriteDataHeader (Ptr<Packet> packet, uint32_t size, const DataHeaderView & view)
+{
+  UpdateAnalysisTag (packet, view.GetDataHeader ());
+  packet->RemoveAtStart (size);
+  packet->AddHeader (view);
+  m_dataHeaderRewrites++;
+}
+
+void
+RoutingProtocol::UpdateAnalysisTag (Ptr<Packet> packet, const DataHeader & dataHeader)
+{
+  if (dataHeader.IsAnalysisInTag ())
+    {
+      AnalysisTag tag;
+      packet->RemovePacketTag (tag);
+      packet->AddPacketTag (AnalysisTag (dataHeader.GetUid (), dataHeader.GetError ()));
+    }
+}
+
+void
+RoutingProtocol::RestoreAnalysisFields (Ptr<const Packet> packet, DataHeader & dataHeader)
+{
+  AnalysisTag tag;
+  if (dataHeader.IsAnalysisInTag () && packet->PeekPacketTag (tag))
+    {
+      dataHeader.SetUid (tag.GetUid ());
+      dataHeader.SetError (tag.GetError ());
+    }
+}
+
+// ADD：收到新的更新包后等待一段随机时间，统计期间收到的重复包，再决定是否转发。
+// 随机的等待时间也避免了邻居节点同时转发造成冲突
+void
+RoutingProtocol::ScheduleRebroadcast (const MyprotocolHeader & header, Ipv4Address sender)
+{
+  std::map<Ipv4Address, PendingRebroadcast>::iterator i = m_pendingRebroadcast.find (header.GetMyadress ());
+  if (i != m_pendingRebroadcast.end ())
+    {
+      // 同一个源节点更新的信息还没发出去，直接用新的替换，沿用原来的发送时间
+      if (header.GetTimestamp () > i->second.m_header.GetTimestamp ())
+        {
+          // 保留两者中较大的传播范围（0为不限），局部更新不能让待转发的全局更新半途而止
+          uint8_t scope = i->second.m_header.GetScope ();
+          i->second.m_header = header;
+          if (scope == 0 || (header.GetScope () != 0 && scope > header.GetScope ()))
+            {
+              i->second.m_header.SetScope (scope);
+            }
+          i->second.m_copies = 1;
+          i->second.m_minDistance = DistanceToRelay (sender);
+          m_coalescedUpdates++;
+        }
+      return;
+    }
+  PendingRebroadcast & pending = m_pendingRebroadcast[header.GetMyadress ()];
+  pending.m_header = header;
+  pending.m_copies = 1;
+  pending.m_minDistance = DistanceToRelay (sender);
+  Time window = m_rebroadcastScheme == BLIND_FLOODING ? m_rebroadcastJitter : m_rebroadcastDelay;
+  Time delay = Seconds (m_uniformRandomVariable->GetValue (0, window.GetSeconds ()));
+  if (m_enableAggregation)
+    {
+      // 聚合模式下所有待转发的更新在同一个时刻一起评估并发送
+      if (!m_aggregationEvent.IsRunning ())
+        {
+          m_aggregationEvent = Simulator::Schedule (delay, &RoutingProtocol::FlushRebroadcasts, this);
+        }
+      return;
+    }
+  pending.m_event = Simulator::Schedule (delay, &RoutingProtocol::AssessRebroadcast, this, header.GetMyadress ());
+}
+
+void
+RoutingProtocol::HeardRebroadcast (const MyprotocolHeader & header, Ipv4Address sender)
+{
+  std::map<Ipv4Address, PendingRebroadcast>::iterator i = m_pendingRebroadcast.find (header.GetMyadress ());
+  if (i == m_pendingRebroadcast.end () || i->second.m_header.GetTimestamp () != header.GetTimestamp ())
+    {
+      return;
+    }
+  i->second.m_copies++;
+  if (m_rebroadcastScheme == DISTANCE_BASED)
+    {
+      i->second.m_minDistance = std::min (i->second.m_minDistance, DistanceToRelay (sender));
+    }
+}
+
+void
+RoutingProtocol::AssessRebroadcast (Ipv4Address origin)
+{
+  std::map<Ipv4Address, PendingRebroadcast>::iterator i = m_pendingRebroadcast.find (origin);
+  if (i == m_pendingRebroadcast.end ())
+    {
+      return;
+    }
+  if (ShouldRebroadcast (i->second))
+    {
+      BroadcastUpdate (i->second.m_header);
+      m_rebroadcastsSent++;
+    }
+  else
+    {
+      m_rebroadcastsSuppressed++;
+    }
+  m_pendingRebroadcast.erase (i);
+}
+
+void
+RoutingProtocol::FlushRebroadcasts ()
+{
+  std::vector<MyprotocolHeader> batch;
+  for (std::map<Ipv4Address, PendingRebroadcast>::const_iterator i = m_pendingRebroadcast.begin ();
+       i != m_pendingRebroadcast.end (); ++i)
+    {
+      if (ShouldRebroadcast (i->second))
+        {
+          batch.push_back (i->second.m_header);
+        }
+      else
+        {
+          m_rebroadcastsSuppressed++;
+        }
+    }
+  m_pendingRebroadcast.clear ();
+  if (!batch.empty ())
+    {
+      BroadcastUpdates (batch);
+      m_rebroadcastsSent += batch.size ();
+    }
+}
+
+bool
+RoutingProtocol::ShouldRebroadcast (const PendingRebroadcast & pending)
+{
+  switch (m_rebroadcastScheme)
+    {
+    case COUNTER_BASED:
+      // 已经听到足够多的副本，说明周围的节点大多已经覆盖
+      return pending.m_copies < m_rebroadcastCounter;
+    case DISTANCE_BASED:
+      // 离最近的转发节点太近，自己转发能覆盖的新区域很小
+      return pending.m_minDistance >= m_rebroadcastDistance;
+    case GOSSIP:
+      return m_uniformRandomVariable->GetValue (0, 1) < m_gossipProbability;
+    default:
+      return true;
+    }
+}
+
+double
+RoutingProtocol::DistanceToRelay (Ipv4Address sender)
+{
+  RoutingTableEntry rt;
+  if (!m_routingTable.LookupRoute (sender, rt))
+    {
+      return std::numeric_limits<double>::max ();
+    }
+  Ptr<MobilityModel> MM = m_ipv4->GetObject<MobilityModel> ();
+  return CalculateDistance (m_routingTable.PredictPosition (sender), MM->GetPosition ());
+}
+
+// ADD：同一条流的数据包在同一秒内通常得到相同的转发决策
+uint32_t
+RoutingProtocol::LookupNextHopCached (Ipv4Address dst, uint16_t dstTimestamp, Vector myPos, Vector dstPos, Ipv4Address & nextHop)
+{
+  int64_t now = Simulator::Now ().ToInteger (Time::S);
+  if (m_nextHopCacheTime != now)
+    {
+      m_nextHopCache.clear ();
+      m_nextHopCacheTime = now;
+    }
+  // 邻居集合和目的地预测位置都没有变化，并且自己移动的距离不足以改变决策时，直接复用
+  std::map<Ipv4Address, NextHopDecision>::iterator i = m_nextHopCache.find (dst);
+  if (i != m_nextHopCache.end ()
+      && i->second.m_dstTimestamp == dstTimestamp
+      && i->second.m_version == m_routingTable.GetNeighborhoodVersion ()
+      && i->second.m_dstPos.x == dstPos.x && i->second.m_dstPos.y == dstPos.y && i->second.m_dstPos.z == dstPos.z
+      && CalculateDistance (myPos, i->second.m_myPos) < i->second.m_stable)
+    {
+      m_nextHopCacheHits++;
+      nextHop = i->second.m_nextHop;
+      return i->second.m_neighborCount;
+    }
+  m_nextHopCacheMisses++;
+  NextHopDecision decision;
+  decision.m_neighborCount = m_routingTable.LookupNextHop (myPos, dstPos, nextHop, decision.m_stable);
+  decision.m_dstTimestamp = dstTimestamp;
+  decision.m_dstPos = dstPos;
+  decision.m_version = m_routingTable.GetNeighborhoodVersion ();
+  decision.m_myPos = myPos;
+  decision.m_nextHop = nextHop;
+  m_nextHopCache[dst] = decision;
+  return decision.m_neighborCount;
+}
+
 // ADD：贪婪转发
 Ipv4Address 
 RoutingProtocol::RecoveryMode(std::map<Ipv4Address, RoutingTableEntry> & neighborTable){
@@ -684,13 +1260,364 @@ RoutingProtocol::RecvMyprotocol (Ptr<Socket> socket)
   Address sourceAddress;
   // RecvFrom中参数的类型是Address
   Ptr<Packet> packet = socket->RecvFrom (sourceAddress);
+  Ipv4Address sender = InetSocketAddress::ConvertFrom (sourceAddress).GetIpv4 ();
+
+  // ADD：uid不在包头中的记录，从起点与记录对齐的字节tag中找回
+  std::map<uint32_t, uint64_t> tagUids;
+  ByteTagIterator tags = packet->GetByteTagIterator ();
+  while (tags.HasNext ())
+    {
+      ByteTagIterator::Item item = tags.Next ();
+      if (item.GetTypeId () == AnalysisTag::GetTypeId ())
+        {
+          AnalysisTag tag;
+          item.GetTag (tag);
+          tagUids[item.GetStart ()] = tag.GetUid ();
+        }
+    }
 
+  if (m_adaptiveRate)
+    {
+      m_heardSenders.insert (sender);
+    }
+
+  // ADD：一个控制包中可能聚合了多个节点的位置信息，逐条处理，记录类型由第一个字节区分
   MyprotocolHeader myprotocolHeader;
-  packet->RemoveHeader (myprotocolHeader);
+  DeltaHeader delta;
+  KeyframeRequestHeader request;
+  LocationRequestHeader locationRequest;
+  LocationReplyHeader locationReply;
+  uint32_t offset = 0;
+  // 最短的记录是关键帧请求
+  while (packet->GetSize () >= request.GetSerializedSize ())
+    {
+      uint32_t start = offset;
+      uint8_t firstByte;
+      packet->CopyData (&firstByte, 1);
+      std::map<uint32_t, uint64_t>::const_iterator tagUid = tagUids.find (start);
+      switch (GetRecordType (firstByte))
+        {
+        case KEYFRAME_REQUEST:
+          offset += packet->RemoveHeader (request);
+          SendKeyframe (request, socket, sender);
+          break;
+        case LOCATION_REQUEST:
+          offset += packet->RemoveHeader (locationRequest);
+          // 没有启用按需位置服务的节点没有回复用的套接字，忽略位置请求和回复
+          if (m_onDemandLocation)
+            {
+              RecvLocationRequest (locationRequest);
+            }
+          break;
+        case LOCATION_REPLY:
+          offset += packet->RemoveHeader (locationReply);
+          if (m_onDemandLocation)
+            {
+              RecvLocationReply (locationReply);
+            }
+          break;
+        case DELTA_RECORD:
+          offset += packet->RemoveHeader (delta);
+          if (delta.IsAnalysisInTag () && tagUid != tagUids.end ())
+            {
+              delta.SetUid (tagUid->second);
+            }
+          if (DecodeDelta (delta, socket, sender, myprotocolHeader))
+            {
+              RecvUpdate (myprotocolHeader, sender);
+            }
+          break;
+        default:
+          offset += packet->RemoveHeader (myprotocolHeader);
+          if (myprotocolHeader.IsAnalysisInTag () && tagUid != tagUids.end ())
+            {
+              myprotocolHeader.SetUid (tagUid->second);
+            }
+          if (m_deltaBeacons)
+            {
+              StoreKeyframe (myprotocolHeader);
+            }
+          RecvUpdate (myprotocolHeader, sender);
+          break;
+        }
+    }
+}
+
+void
+RoutingProtocol::StoreKeyframe (const MyprotocolHeader & header)
+{
+  std::map<Ipv4Address, MyprotocolHeader>::iterator keyframe = m_keyframes.find (header.GetMyadress ());
+  if (keyframe == m_keyframes.end ())
+    {
+      m_keyframes.insert (std::make_pair (header.GetMyadress (), header));
+    }
+  else if (header.GetTimestamp () != keyframe->second.GetTimestamp ())
+    {
+      // 同一秒的记录不替换，邻居保存的关键帧与源节点的一致
+      std::vector<MyprotocolHeader> & history = m_olderKeyframes[header.GetMyadress ()];
+      MyprotocolHeader older = header;
+      if (header.GetTimestamp () > keyframe->second.GetTimestamp ())
+        {
+          older = keyframe->second;
+          keyframe->second = header;
+        }
+      // 较旧的关键帧可能是某个转发节点正在使用的（例如向它请求得到的），保留在历史中
+      for (std::vector<MyprotocolHeader>::const_iterator i = history.begin (); i != history.end (); ++i)
+        {
+          if (i->GetTimestamp () == older.GetTimestamp ())
+            {
+              return;
+            }
+        }
+      history.push_back (older);
+      if (history.size () > KEYFRAME_HISTORY)
+        {
+          history.erase (history.begin ());
+        }
+    }
+}
+
+bool
+RoutingProtocol::FindKeyframe (Ipv4Address node, uint16_t timestamp, MyprotocolHeader & keyframe) const
+{
+  std::map<Ipv4Address, MyprotocolHeader>::const_iterator newest = m_keyframes.find (node);
+  if (newest != m_keyframes.end () && newest->second.GetTimestamp () == timestamp)
+    {
+      keyframe = newest->second;
+      return true;
+    }
+  std::map<Ipv4Address, std::vector<MyprotocolHeader> >::const_iterator history = m_olderKeyframes.find (node);
+  if (history == m_olderKeyframes.end ())
+    {
+      return false;
+    }
+  for (std::vector<MyprotocolHeader>::const_iterator i = history->second.begin (); i != history->second.end (); ++i)
+    {
+      if (i->GetTimestamp () == timestamp)
+        {
+          keyframe = *i;
+          return true;
+        }
+    }
+  return false;
+}
+
+bool
+RoutingProtocol::DecodeDelta (const DeltaHeader & delta, Ptr<Socket> socket, Ipv4Address sender, MyprotocolHeader & header)
+{
+  MyprotocolHeader keyframe;
+  if (FindKeyframe (delta.GetMyadress (), delta.GetKeyframeTimestamp (), keyframe))
+    {
+      header = delta.Decode (keyframe);
+      return true;
+    }
+  m_keyframeMisses++;
+
+  // 发送这个差分更新的邻居刚用这个关键帧编码过，向它请求。每个节点每秒最多请求一次
+  std::map<Ipv4Address, Time>::iterator last = m_keyframeRequests.find (delta.GetMyadress ());
+  if (last != m_keyframeRequests.end () && Simulator::Now () - last->second < Seconds (1))
+    {
+      return false;
+    }
+  m_keyframeRequests[delta.GetMyadress ()] = Simulator::Now ();
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddHeader (KeyframeRequestHeader (delta.GetMyadress (), delta.GetKeyframeTimestamp ()));
+  socket->SendTo (packet, 0, InetSocketAddress (sender, MYPROTOCOL_PORT));
+  return false;
+}
+
+void
+RoutingProtocol::SendKeyframe (const KeyframeRequestHeader & request, Ptr<Socket> socket, Ipv4Address sender)
+{
+  MyprotocolHeader header;
+  if (!FindKeyframe (request.GetMyadress (), request.GetTimestamp (), header))
+    {
+      return;
+    }
+  // 只发给请求者，传播范围为1，请求者不再转发
+  header.SetScope (1);
+  Ptr<Packet> packet = Create<Packet> ();
+  AddUpdateRecord (packet, header);
+  socket->SendTo (packet, 0, InetSocketAddress (sender, MYPROTOCOL_PORT));
+}
+
+MyprotocolHeader
+RoutingProtocol::OwnRecord ()
+{
+  int16_t vx = m_lastReportVelocity.x;
+  int16_t vy = m_lastReportVelocity.y;
+  int16_t vz = m_lastReportVelocity.z;
+  return MyprotocolHeader (m_lastReportPos.x, m_lastReportPos.y, m_lastReportPos.z, abs (vx), abs (vy), abs (vz),
+                           SetRightVelocity (vx, vy, vz), m_lastSendTime, m_ipv4->GetAddress (1, 0).GetLocal ());
+}
+
+void
+RoutingProtocol::RequestLocation (Ipv4Address dst)
+{
+  if (m_locationQueries.find (dst) != m_locationQueries.end ())
+    {
+      return;
+    }
+  m_locationQueries[dst].m_ttl = m_locationTtlStart;
+  SendLocationRequest (dst, m_locationTtlStart);
+}
+
+void
+RoutingProtocol::SendLocationRequest (Ipv4Address dst, uint32_t ttl)
+{
+  LocationRequestHeader request (dst, ++m_locationRequestId, ttl, OwnRecord ());
+  // 自己的请求被邻居转发回来时直接丢弃
+  m_locationIdCache.IsDuplicate (m_ipv4->GetAddress (1, 0).GetLocal (), request.GetId ());
+  BroadcastLocationRequest (request);
+  m_locationRequestsSent++;
+  // 等待请求到达环的边缘、回复返回的时间，与AODV的RingTraversalTime相同
+  Time timeout = (2 * (ttl + 2)) * m_nodeTraversalTime;
+  m_locationQueries[dst].m_timeout = Simulator::Schedule (timeout, &RoutingProtocol::LocationRequestTimeout, this, dst);
+}
+
+void
+RoutingProtocol::LocationRequestTimeout (Ipv4Address dst)
+{
+  std::map<Ipv4Address, LocationQuery>::iterator query = m_locationQueries.find (dst);
+  if (query == m_locationQueries.end ())
+    {
+      return;
+    }
+  // 已经收到回复（队列中的数据包已经发出），或者数据包已经超时
+  RoutingTableEntry rt;
+  if (m_routingTable.LookupRoute (dst, rt) || !m_queue.Find (dst))
+    {
+      m_locationQueries.erase (query);
+      return;
+    }
+  if (query->second.m_ttl >= m_netDiameter)
+    {
+      m_queue.DropPacketWithDst (dst);
+      m_locationQueries.erase (query);
+      return;
+    }
+  uint32_t ttl = query->second.m_ttl + m_locationTtlIncrement;
+  if (ttl > m_locationTtlThreshold)
+    {
+      ttl = m_netDiameter;
+    }
+  query->second.m_ttl = ttl;
+  SendLocationRequest (dst, ttl);
+}
+
+void
+RoutingProtocol::BroadcastLocationRequest (const LocationRequestHeader & request)
+{
+  for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator j = m_socketAddresses.begin (); j
+       != m_socketAddresses.end (); ++j)
+    {
+      Ptr<Socket> socket = j->first;
+      Ipv4InterfaceAddress iface = j->second;
+      Ipv4Address destination;
+      if (iface.GetMask () == Ipv4Mask::GetOnes ())
+        {
+          destination = Ipv4Address ("255.255.255.255");
+        }
+      else
+        {
+          destination = iface.GetBroadcast ();
+        }
+      Ptr<Packet> packet = Create<Packet> ();
+      packet->AddHeader (request);
+      socket->SendTo (packet, 0, InetSocketAddress (destination, MYPROTOCOL_PORT));
+    }
+}
+
+void
+RoutingProtocol::RecvLocationRequest (const LocationRequestHeader & request)
+{
+  const MyprotocolHeader & origin = request.GetOrigin ();
+  if (m_locationIdCache.IsDuplicate (origin.GetMyadress (), request.GetId ()))
+    {
+      return;
+    }
+
+  // 记录请求者的位置，回复和之后的数据包按这个位置贪婪转发回去
+  RoutingTableEntry rt;
+  if (!m_routingTable.LookupRoute (origin.GetMyadress (), rt) || rt.GetTimestamp () < origin.GetTimestamp ())
+    {
+      Vector velocity = GetRightVelocity (origin.GetVx (), origin.GetVy (), origin.GetVz (), origin.GetSign ());
+      RoutingTableEntry entry (origin.GetX (), origin.GetY (), origin.GetZ (), velocity.x, velocity.y, velocity.z,
+                               origin.GetTimestamp (), origin.GetMyadress ());
+      m_routingTable.Update (entry);
+    }
+
+  // 目标是自己，或者位置表中有目标（例如目标是一跳邻居）时回复，不再转发
+  if (request.GetTarget () == m_ipv4->GetAddress (1, 0).GetLocal ())
+    {
+      SendLocationReply (OwnRecord (), origin.GetMyadress ());
+      return;
+    }
+  if (m_routingTable.LookupRoute (request.GetTarget (), rt))
+    {
+      MyprotocolHeader record (rt.GetX (), rt.GetY (), rt.GetZ (), abs (rt.GetVx ()), abs (rt.GetVy ()), abs (rt.GetVz ()),
+                               SetRightVelocity (rt.GetVx (), rt.GetVy (), rt.GetVz ()), rt.GetTimestamp (), rt.GetAdress ());
+      SendLocationReply (record, origin.GetMyadress ());
+      return;
+    }
+  if (request.GetTtl () > 1)
+    {
+      LocationRequestHeader relayed = request;
+      relayed.SetTtl (request.GetTtl () - 1);
+      // 随机延迟，避免邻居同时转发发生碰撞
+      Simulator::Schedule (MilliSeconds (m_uniformRandomVariable->GetInteger (0, 10)),
+                           &RoutingProtocol::BroadcastLocationRequest, this, relayed);
+    }
+}
+
+void
+RoutingProtocol::SendLocationReply (MyprotocolHeader record, Ipv4Address origin)
+{
+  // 回复只给请求者，使用单独的记录类型，请求者不做重复检查也不转发
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddHeader (LocationReplyHeader (record));
+  m_replySocket->SendTo (packet, 0, InetSocketAddress (origin, MYPROTOCOL_PORT));
+  m_locationRepliesSent++;
+}
+
+void
+RoutingProtocol::RecvLocationReply (const LocationReplyHeader & reply)
+{
+  // 回复不经过IdCache：请求者可能收到过同一条记录，但表项已经过期，这正是发出请求的原因
+  MyprotocolHeader record = reply.GetRecord ();
+  RoutingTableEntry rt;
+  if (!m_routingTable.LookupRoute (record.GetMyadress (), rt) || rt.GetTimestamp () < record.GetTimestamp ())
+    {
+      Vector velocity = GetRightVelocity (record.GetVx (), record.GetVy (), record.GetVz (), record.GetSign ());
+      RoutingTableEntry entry (record.GetX (), record.GetY (), record.GetZ (), velocity.x, velocity.y, velocity.z,
+                               record.GetTimestamp (), record.GetMyadress ());
+      m_routingTable.Update (entry);
+    }
+  else
+    {
+      // 表中的记录更新，用它发送等待的数据包
+      record = MyprotocolHeader (rt.GetX (), rt.GetY (), rt.GetZ (), abs (rt.GetVx ()), abs (rt.GetVy ()), abs (rt.GetVz ()),
+                                 SetRightVelocity (rt.GetVx (), rt.GetVy (), rt.GetVz ()), rt.GetTimestamp (), rt.GetAdress ());
+    }
+  std::map<Ipv4Address, LocationQuery>::iterator query = m_locationQueries.find (record.GetMyadress ());
+  if (query != m_locationQueries.end ())
+    {
+      query->second.m_timeout.Cancel ();
+      m_locationQueries.erase (query);
+    }
+  SendQueuedPackets (record);
+}
+
+void
+RoutingProtocol::RecvUpdate (MyprotocolHeader myprotocolHeader, Ipv4Address sender)
+{
+  // ADD：重复的记录同样占用信道，也计入负载
+  m_receivedRecords++;
 
   // ADD:检查是否已经转发过，如果是则丢弃。
   if (m_idCache.IsDuplicate (myprotocolHeader.GetMyadress(), myprotocolHeader.GetTimestamp()))
   {
+    HeardRebroadcast (myprotocolHeader, sender);
     return;
   }
 
@@ -708,25 +1635,33 @@ RoutingProtocol::RecvMyprotocol (Ptr<Socket> socket)
   );
   m_routingTable.Update(newEntry);
 
-  Ptr<Packet> p = Create<Packet> ();
-  p->AddHeader(myprotocolHeader);
-  for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator j = m_socketAddresses.begin (); j
-       != m_socketAddresses.end (); ++j)
-  {
-    Ptr<Socket> socket = j->first;
-    Ipv4InterfaceAddress iface = j->second;
-    Ipv4Address destination;
-    if (iface.GetMask () == Ipv4Mask::GetOnes ())
-      {
-        destination = Ipv4Address ("255.255.255.255");
-      }
-    else
-      {
-        destination = iface.GetBroadcast ();
-      }
-    socket->SendTo (p, 0, InetSocketAddress (destination, MYPROTOCOL_PORT));
-  }
+  // ADD：传播范围为1说明已经到达最后一跳，不再转发
+  uint8_t scope = myprotocolHeader.GetScope ();
+  if (scope != 1)
+    {
+      MyprotocolHeader relayed = myprotocolHeader;
+      if (scope > 1)
+        {
+          relayed.SetScope (scope - 1);
+        }
+      if (m_rebroadcastScheme == BLIND_FLOODING && m_rebroadcastJitter.IsZero () && !m_enableAggregation)
+        {
+          BroadcastUpdate (relayed);
+          m_rebroadcastsSent++;
+        }
+      else
+        {
+          ScheduleRebroadcast (relayed, sender);
+        }
+    }
+
+  SendQueuedPackets (myprotocolHeader);
+}
 
+// ADD：目的地的位置更新到达后，发送队列中等待该目的地的数据包
+void
+RoutingProtocol::SendQueuedPackets (const MyprotocolHeader & myprotocolHeader)
+{
   // 如果不能使用队列，直接返回
   if(!m_enableQueue){
     return;
@@ -734,6 +1669,8 @@ RoutingProtocol::RecvMyprotocol (Ptr<Socket> socket)
 
   if(m_queue.Find(myprotocolHeader.GetMyadress())){
     DataHeader dataHeader;
+    dataHeader.SetCompact(m_compactDataHeader);
+    dataHeader.SetAnalysisInTag(m_analysisInTags);
     // 将rt中关于目的地的位置、速度和时间戳写进dataHeader
     dataHeader.SetDstPosx(myprotocolHeader.GetX());
     dataHeader.SetDstPosy(myprotocolHeader.GetY());
@@ -746,11 +1683,8 @@ RoutingProtocol::RecvMyprotocol (Ptr<Socket> socket)
 
     m_routingTable.Purge();
 
-    //更新邻居表，以便打印路由 
     Ptr<MobilityModel> MM = m_ipv4->GetObject<MobilityModel> ();
     Vector myPos = MM->GetPosition();
-    std::map<Ipv4Address, RoutingTableEntry> neighborTable;
-    m_routingTable.LookupNeighbor(neighborTable, myPos);
 
     // 根据预测的目的地位置，选择最优的下一跳
     Vector dstPos = m_routingTable.PredictPosition(myprotocolHeader.GetMyadress());
@@ -759,15 +1693,17 @@ RoutingProtocol::RecvMyprotocol (Ptr<Socket> socket)
     uint16_t error = CalculateDistance(dstPos, realDstPos);
     dataHeader.SetError(error);
 
+    Ipv4Address nexthop;
+    uint32_t neighborCount = m_routingTable.LookupNextHop(myPos, dstPos, nexthop);
+
     // 没有邻居，则从队列中删除，并丢弃
-    if(neighborTable.size() == 0){
+    if(neighborCount == 0){
       m_queue.DropPacketWithDst(myprotocolHeader.GetMyadress());
       return;
     }
 
     // 查找route
     Ptr<Ipv4Route> route = Create<Ipv4Route> ();
-    Ipv4Address nexthop = m_routingTable.BestNeighbor(neighborTable, dstPos, myPos);
     // 数据包找到了合适的下一跳
     if(nexthop != Ipv4Address::GetZero ()){
       dataHeader.SetRecPosx(0);
@@ -786,7 +1722,9 @@ RoutingProtocol::RecvMyprotocol (Ptr<Socket> socket)
         dataHeader.SetRecPosz((uint16_t)myPos.z);
         dataHeader.SetInRec(1);
         // 恢复模式获得下一跳
-        Ipv4Address nexthop = RecoveryMode (neighborTable);
+        std::map<Ipv4Address, RoutingTableEntry> neighborTable;
+        m_routingTable.LookupNeighbor(neighborTable, myPos);
+        nexthop = RecoveryMode (neighborTable);
         route->SetDestination (myprotocolHeader.GetMyadress());
         route->SetGateway (nexthop);
         route->SetSource (m_ipv4->GetAddress (1, 0).GetLocal ()); 
@@ -814,27 +1752,167 @@ RoutingProtocol::CheckChange ()
   NextTimeMobilityPos.y = myPos.y + myVel.y;
   NextTimeMobilityPos.z = myPos.z + myVel.z;
 
-  // 使用上次更新的位置信息来预测节点下一秒在的位置
-  uint16_t t = Simulator::Now ().ToInteger(Time::S) - m_lastSendTime;
-  Vector NextTimeTablePos;
-  NextTimeTablePos.x = m_lastSendPos.x + m_lastSendVelocity.x * (t + 1);
-  NextTimeTablePos.y = m_lastSendPos.y + m_lastSendVelocity.y * (t + 1);
-  NextTimeTablePos.z = m_lastSendPos.z + m_lastSendVelocity.z * (t + 1);
+  // 使用上次更新的位置信息来预测节点下一秒在的位置，与邻居使用同一个预测模型
+  Vector NextTimeTablePos = AdvertisedPosition (Simulator::Now ().ToInteger(Time::S) + 1);
   
   double distance = CalculateDistance(NextTimeMobilityPos, NextTimeTablePos);
 
   // 1. 超出阈值就更新
-  if(distance > m_transRange * m_scaleFactor){
+  if(distance > UpdateThreshold ()){
     // 将本次更新的速度、方向记录
     SendUpdate();
   }
   // 如果超过最大间隔时间没有发送更新包，则发送
-  if(Simulator::Now ().ToInteger(Time::S) - m_lastSendTime > m_maxIntervalTime){
+  if(Simulator::Now ().ToInteger(Time::S) - m_lastSendTime > MaxUpdateInterval ()){
     SendUpdate();
   }
   m_checkChangeTimer.Schedule (m_checkChangeInterval + MicroSeconds (25 * m_uniformRandomVariable->GetInteger (0,1000)));
 }
 
+// ADD：移动模型改变速度或方向时，重新计算下一次检查的时刻
+void
+RoutingProtocol::CourseChanged (Ptr<const MobilityModel> mobility)
+{
+  ScheduleKinematicCheck ();
+}
+
+// ADD：假设节点保持当前的速度直到下一次CourseChange，求广播出去的预测位置与实际位置的距离
+// 达到阈值的时刻。偏差 d(t) = d0 + dv * t，解 |d(t)| = R 的最小非负根
+void
+RoutingProtocol::ScheduleKinematicCheck ()
+{
+  Ptr<MobilityModel> MM = m_ipv4->GetObject<MobilityModel> ();
+  Vector myPos = MM->GetPosition();
+  Vector myVel = MM->GetVelocity();
+  double now = Simulator::Now ().GetSeconds ();
+  double range = UpdateThreshold ();
+  // 超过最大间隔时间没有发送更新包也要发送，与CheckChange一样在间隔之后的下一秒
+  double deadline = m_lastSendTime + std::floor (MaxUpdateInterval ()) + 1;
+  double delay = deadline - now;
+
+  if (m_selfPredictor != 0 && !m_selfPredictor->IsConstantVelocity ())
+    {
+      // 其他运动模型的轨迹没有简单的解析解。接收端只在整秒预测，逐秒检查，
+      // 与CheckChange一样提前一秒发送
+      if (CalculateDistance (myPos, AdvertisedPosition (now)) > range)
+        {
+          delay = 0;
+        }
+      for (double t = std::floor (now) + 1; t <= deadline && delay > 0; t++)
+        {
+          Vector real (myPos.x + myVel.x * (t - now), myPos.y + myVel.y * (t - now), myPos.z + myVel.z * (t - now));
+          if (CalculateDistance (real, AdvertisedPosition (t)) > range)
+            {
+              delay = t - 1 - now;
+            }
+        }
+    }
+  else
+    {
+      double elapsed = now - m_lastSendTime;
+      Vector d0 (myPos.x - (m_lastSendPos.x + m_lastSendVelocity.x * elapsed),
+                 myPos.y - (m_lastSendPos.y + m_lastSendVelocity.y * elapsed),
+                 myPos.z - (m_lastSendPos.z + m_lastSendVelocity.z * elapsed));
+      Vector dv (myVel.x - m_lastSendVelocity.x, myVel.y - m_lastSendVelocity.y, myVel.z - m_lastSendVelocity.z);
+      double a = dv.x * dv.x + dv.y * dv.y + dv.z * dv.z;
+      double b = d0.x * dv.x + d0.y * dv.y + d0.z * dv.z;
+      double c = d0.x * d0.x + d0.y * d0.y + d0.z * d0.z - range * range;
+      if (c >= 0)
+        {
+          delay = 0;
+        }
+      else if (a > 0)
+        {
+          // c < 0，判别式为正，并且只有一个正根
+          delay = std::min (delay, (-b + std::sqrt (b * b - a * c)) / a);
+        }
+    }
+
+  m_checkChangeTimer.Cancel ();
+  m_checkChangeTimer.Schedule (Seconds (std::max (delay, 0.0)));
+}
+
+void
+RoutingProtocol::KinematicCheck ()
+{
+  SendUpdate ();
+  ScheduleKinematicCheck ();
+}
+
+// ADD：每秒统计一次听到的邻居数和收到的更新记录数。整个区域的控制开销约为节点数除以
+// 缩放系数，系数随密度线性增长时单位面积的开销基本不变
+void
+RoutingProtocol::UpdateRateScale ()
+{
+  m_neighborEstimate = 0.5 * m_neighborEstimate + 0.5 * m_heardSenders.size ();
+  m_controlLoad = 0.5 * m_controlLoad + 0.5 * m_receivedRecords;
+  m_heardSenders.clear ();
+  m_receivedRecords = 0;
+
+  double scale = m_neighborEstimate / m_targetNeighbors;
+  if (m_targetControlLoad > 0)
+    {
+      scale = std::max (scale, m_controlLoad / m_targetControlLoad);
+    }
+  scale = std::min (std::max (scale, m_minRateScale), m_maxRateScale);
+  if (scale != m_rateScale.Get ())
+    {
+      m_rateScale = scale;
+      // 事件驱动的检查按新的阈值重新计算时间
+      if (m_kinematicTrigger)
+        {
+          ScheduleKinematicCheck ();
+        }
+    }
+  m_rateControlEvent = Simulator::Schedule (Seconds (1), &RoutingProtocol::UpdateRateScale, this);
+}
+
+double
+RoutingProtocol::UpdateThreshold () const
+{
+  return m_transRange * m_scaleFactor * m_rateScale.Get ();
+}
+
+double
+RoutingProtocol::MaxUpdateInterval () const
+{
+  // 更新包最晚在间隔结束后的下一次检查时发出，必须早于邻居表项的最长寿命，否则静止节点会周期性地从邻居表中消失
+  double limit = m_maxEntryLifeTime.ToInteger (Time::S) - m_checkChangeInterval.GetSeconds () - 1;
+  return std::max (std::min (m_maxIntervalTime * m_rateScale.Get (), limit), 1.0);
+}
+
+Ptr<MotionPredictor>
+RoutingProtocol::CreatePredictor () const
+{
+  switch (m_predictorType)
+    {
+    case CONSTANT_ACCELERATION:
+      return Create<ConstantAccelerationPredictor> ();
+    case KALMAN:
+      return Create<KalmanPredictor> (m_kalmanProcessNoise);
+    default:
+      return Create<ConstantVelocityPredictor> ();
+    }
+}
+
+// ADD：邻居根据上次更新包预测的本节点位置。匀速模型保持原来的计算，
+// 其他模型使用与接收端相同的量化后的报告
+Vector
+RoutingProtocol::AdvertisedPosition (double t) const
+{
+  if (m_selfPredictor == 0 || m_selfPredictor->IsConstantVelocity ())
+    {
+      double dt = t - m_lastSendTime;
+      return Vector (m_lastSendPos.x + m_lastSendVelocity.x * dt,
+                     m_lastSendPos.y + m_lastSendVelocity.y * dt,
+                     m_lastSendPos.z + m_lastSendVelocity.z * dt);
+    }
+  return m_selfPredictor->Predict (m_ipv4->GetAddress (1, 0).GetLocal ().Get (),
+                                   Vector (m_lastReportPos.x, m_lastReportPos.y, m_lastReportPos.z),
+                                   Vector (m_lastReportVelocity.x, m_lastReportVelocity.y, m_lastReportVelocity.z),
+                                   m_lastSendTime, t);
+}
+
 // 周期发送控制包
 void
 RoutingProtocol::SendUpdate ()
@@ -891,7 +1969,58 @@ RoutingProtocol::SendUpdate ()
   myprotocolHeader.SetMyadress(m_ipv4->GetAddress (1, 0).GetLocal ());
   myprotocolHeader.SetUid(packet->GetUid ());
 
-  packet->AddHeader (myprotocolHeader);
+  // ADD：记录邻居收到的量化后的报告，让自己的预测器与邻居的保持一致
+  m_lastReportPos = Vector ((uint16_t)myPos.x, (uint16_t)myPos.y, (uint16_t)myPos.z);
+  m_lastReportVelocity = Vector (vx, vy, vz);
+  if (m_selfPredictor != 0)
+    {
+      m_selfPredictor->Observe (myprotocolHeader.GetMyadress ().Get (), m_lastReportPos, m_lastReportVelocity, m_lastSendTime);
+    }
+
+  // ADD：距离效应，每隔GlobalUpdateInterval才发送一次全网传播的更新包
+  if (m_enableDistanceEffect)
+    {
+      if (m_lastGlobalUpdateTime < 0
+          || m_lastSendTime - m_lastGlobalUpdateTime >= m_globalUpdateInterval.ToInteger (Time::S))
+        {
+          m_lastGlobalUpdateTime = m_lastSendTime;
+        }
+      else
+        {
+          myprotocolHeader.SetScope (m_localUpdateScope);
+        }
+    }
+
+  // ADD：按需位置服务中更新包只是一跳的信标，其他节点的位置通过位置请求获得
+  if (m_onDemandLocation)
+    {
+      myprotocolHeader.SetScope (1);
+    }
+
+  // ADD：差分更新。每KeyframeInterval次更新，或者传播范围超出上一个关键帧时，发送新的关键帧
+  if (m_deltaBeacons)
+    {
+      std::map<Ipv4Address, MyprotocolHeader>::const_iterator keyframe = m_keyframes.find (myprotocolHeader.GetMyadress ());
+      uint8_t scope = myprotocolHeader.GetScope ();
+      if (keyframe == m_keyframes.end ()
+          || m_updatesSinceKeyframe >= m_keyframeInterval
+          || (keyframe->second.GetScope () != 0 && (scope == 0 || scope > keyframe->second.GetScope ())))
+        {
+          m_keyframes[myprotocolHeader.GetMyadress ()] = myprotocolHeader;
+          m_updatesSinceKeyframe = 0;
+        }
+      else if (keyframe->second.GetTimestamp () == myprotocolHeader.GetTimestamp ())
+        {
+          // 与关键帧同一秒的更新也是完整的记录，只收到它的邻居会把它当作关键帧，下一次更新重新发送关键帧
+          m_updatesSinceKeyframe = m_keyframeInterval;
+        }
+      else
+        {
+          m_updatesSinceKeyframe++;
+        }
+    }
+
+  AddUpdateRecord (packet, myprotocolHeader);
 
   for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator j = m_socketAddresses.begin (); j
        != m_socketAddresses.end (); ++j)
@@ -918,37 +2047,21 @@ RoutingProtocol::SendUpdate ()
 void
 RoutingProtocol::SendPacketFromQueue (Ipv4Address dst, Ptr<Ipv4Route> route, DataHeader dataHeader)
 {
-  QueueEntry queueEntry;
-  while (m_queue.Dequeue (dst, queueEntry))
+  // 一次取出该目的地的全部数据包
+  std::vector<QueueEntry> entries;
+  m_queue.DequeueAll (dst, entries);
+  for (std::vector<QueueEntry>::const_iterator queueEntry = entries.begin (); queueEntry != entries.end (); ++queueEntry)
     {
-      Ptr<Packet> p = ConstCast<Packet> (queueEntry.GetPacket ());
+      Ptr<Packet> p = ConstCast<Packet> (queueEntry->GetPacket ());
+      Ipv4Header header = queueEntry->GetIpv4Header ();
 
-      // 在queue中的数据包已经添加了udpheader的头
-      PacketMetadata::ItemIterator i = p->BeginItem();
-      PacketMetadata::Item item = i.Next ();
-      TypeId id = item.tid;
-      Icmpv4Header icmpv4Header;
-      UdpHeader udpHeader;
+      // 在queue中的数据包已经添加了传输层头，和数据头一起一次替换
+      DataHeaderView view (TransportHeaderSize (header));
+      uint32_t viewSize = PeekDataHeader (p, view);
+      view.GetDataHeader () = dataHeader;
+      RewriteDataHeader (p, viewSize, view);
 
-      // icmpv4的包
-      if(id == icmpv4Header.GetTypeId()){
-        std::cout<<"this is not udp packet!!!\n";
-        p->RemoveHeader(icmpv4Header);
-      }else{
-        p->RemoveHeader(udpHeader);
-      }
-      DataHeader dataHeader0;
-      p->RemoveHeader(dataHeader0);
-
-      p->AddHeader (dataHeader);
-      if(id == icmpv4Header.GetTypeId()){
-        p->AddHeader(icmpv4Header);
-      }else{
-        p->AddHeader(udpHeader);
-      }
-      
-      UnicastForwardCallback ucb = queueEntry.GetUnicastForwardCallback ();
-      Ipv4Header header = queueEntry.GetIpv4Header ();
+      UnicastForwardCallback ucb = queueEntry->GetUnicastForwardCallback ();
       ucb (route, p, header);
     }
 }
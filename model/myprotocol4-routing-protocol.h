@@ -11,11 +11,13 @@
 #include "ns3/ipv4-interface.h"
 #include "ns3/ipv4-l3-protocol.h"
 #include "ns3/output-stream-wrapper.h"
+#include "ns3/traced-value.h"
 // 添加移动模型
 #include "ns3/mobility-model.h"
 // 添加位置服务
 #include "ns3/god.h"
 #include<cmath>
+#include <set>
 
 namespace ns3 {
 namespace myprotocol4 {
@@ -26,6 +28,22 @@ public:
   static TypeId GetTypeId (void);
   static const uint32_t MYPROTOCOL_PORT;
 
+  /// Rebroadcast schemes for flooded position updates
+  enum RebroadcastScheme
+  {
+    BLIND_FLOODING,     ///< rebroadcast every new update immediately
+    COUNTER_BASED,      ///< rebroadcast unless enough copies were heard during the assessment delay
+    DISTANCE_BASED,     ///< rebroadcast unless a copy was heard from a relay closer than the threshold
+    GOSSIP              ///< rebroadcast with a fixed probability
+  };
+  /// Motion model shared by the senders and the receivers of position updates
+  enum PredictorType
+  {
+    CONSTANT_VELOCITY,          ///< dead reckoning with the reported velocity
+    CONSTANT_ACCELERATION,      ///< plus the acceleration between the last two reports
+    KALMAN                      ///< per-node Kalman filter over the reports
+  };
+
   RoutingProtocol ();
   virtual
   ~RoutingProtocol ();
@@ -60,6 +78,14 @@ private:
   bool m_enableQueue;
   // ADD: 检查改变的时间周期  
   Time m_checkChangeInterval;   //检查改变的时间周期  
+  // ADD: 位置表过期时间轮的粒度
+  Time m_purgeGranularity;
+  // ADD: 表项生命周期根据速度调整，快速节点的旧位置更早过期
+  double m_entryErrorBudget;
+  Time m_minEntryLifeTime;
+  Time m_maxEntryLifeTime;
+  // ADD: id-cache是否只记录每个源节点最新的时间戳
+  bool m_enableIdCacheHighWaterMark;
 
   /// Nodes IP address
   Ipv4Address m_mainAddress;
@@ -85,7 +111,17 @@ private:
   uint16_t m_lastSendTime;        //上次发送更新包的时间
   Vector m_lastSendPos;
   Vector m_lastSendVelocity;
+  Vector m_lastReportPos;         ///< position of the last update as sent, clamped and truncated
+  Vector m_lastReportVelocity;    ///< velocity of the last update as sent, truncated
   uint16_t m_maxIntervalTime;    //最大不发送更新包的时间间隔
+  // ADD：根据运动学计算更新时间，由CourseChange触发，不再定期检查
+  bool m_kinematicTrigger;
+  // ADD：位置预测模型，发送端和接收端使用同一个模型
+  PredictorType m_predictorType;
+  /// acceleration noise variance of the Kalman predictor
+  double m_kalmanProcessNoise;
+  /// predictor fed with the own updates, it yields the trajectory the neighbors assume
+  Ptr<MotionPredictor> m_selfPredictor;
 
   // ADD:id-cache
   IdCache m_idCache;
@@ -101,6 +137,128 @@ private:
 
   // ADD：位置服务，用来统计位置误差
   Ptr<LocationService> m_locationService;
+
+  /// Greedy decision of Forwarding for one destination
+  struct NextHopDecision
+  {
+    uint16_t m_dstTimestamp;    ///< timestamp of the destination entry
+    Vector m_dstPos;            ///< predicted destination position
+    uint32_t m_version;         ///< neighborhood version of the routing table
+    Vector m_myPos;             ///< own position when the decision was made
+    double m_stable;            ///< the decision holds while closer than this to m_myPos
+    Ipv4Address m_nextHop;      ///< chosen neighbor, zero for recovery mode
+    uint32_t m_neighborCount;   ///< number of neighbors
+  };
+  /// ADD：转发决策缓存，每秒清空
+  std::map<Ipv4Address, NextHopDecision> m_nextHopCache;
+  /// second in which m_nextHopCache was filled
+  int64_t m_nextHopCacheTime;
+  /// number of forwarded packets that reused a cached decision
+  TracedValue<uint32_t> m_nextHopCacheHits;
+  /// number of forwarded packets that computed the decision
+  TracedValue<uint32_t> m_nextHopCacheMisses;
+  /// number of transport and data headers replaced in one step
+  TracedValue<uint32_t> m_dataHeaderRewrites;
+  /// number of data packets dropped on the peeked headers
+  TracedValue<uint32_t> m_dropsWithoutCopy;
+
+  // ADD：控制包转发抑制
+  RebroadcastScheme m_rebroadcastScheme;
+  Time m_rebroadcastDelay;              ///< upper bound of the random assessment delay
+  Time m_rebroadcastJitter;             ///< upper bound of the random delay of blind rebroadcasts
+  uint32_t m_rebroadcastCounter;        ///< copies that suppress a counter-based rebroadcast
+  double m_rebroadcastDistance;         ///< relay distance below which a distance-based rebroadcast is suppressed
+  double m_gossipProbability;           ///< rebroadcast probability of gossip
+  /// A received update waiting for its rebroadcast assessment
+  struct PendingRebroadcast
+  {
+    MyprotocolHeader m_header;          ///< the update
+    uint32_t m_copies;                  ///< number of copies received
+    double m_minDistance;               ///< distance to the closest relay heard
+    EventId m_event;                    ///< the assessment
+  };
+  // ADD：源节点使用紧凑的变长数据头，转发节点沿用收到的格式
+  bool m_compactDataHeader;
+  // ADD：uid和error只用于仿真分析，放在tag中传递，不占用空口开销
+  bool m_analysisInTags;
+  // ADD：聚合转发，多个节点的更新放在同一个帧中
+  bool m_enableAggregation;
+  /// the pending flush of the aggregated rebroadcasts
+  EventId m_aggregationEvent;
+  /// origin -> pending rebroadcast of its newest update
+  std::map<Ipv4Address, PendingRebroadcast> m_pendingRebroadcast;
+  /// number of position updates rebroadcast
+  TracedValue<uint32_t> m_rebroadcastsSent;
+  /// number of position updates whose rebroadcast was suppressed
+  TracedValue<uint32_t> m_rebroadcastsSuppressed;
+  /// number of pending rebroadcasts replaced by a newer update of the same origin
+  TracedValue<uint32_t> m_coalescedUpdates;
+
+  // ADD：距离效应，频繁的更新只在附近传播，远处的节点靠间隔较长的全网更新
+  bool m_enableDistanceEffect;
+  uint32_t m_localUpdateScope;          ///< hops a local update travels
+  Time m_globalUpdateInterval;          ///< minimum interval between network-wide updates
+  int64_t m_lastGlobalUpdateTime;       ///< second of the last network-wide update, -1 if none
+
+  // ADD：差分更新，大部分更新只发送相对于上一个关键帧的变化量
+  bool m_deltaBeacons;
+  uint32_t m_keyframeInterval;          ///< number of delta updates between two keyframes
+  uint32_t m_updatesSinceKeyframe;      ///< delta updates sent since the own last keyframe
+  /// node -> its newest keyframe, the base of its delta updates
+  std::map<Ipv4Address, MyprotocolHeader> m_keyframes;
+  /**
+   * node -> older keyframes, oldest arrival first. A relay encodes against
+   * the newest keyframe it holds, which may be older than ours.
+   */
+  std::map<Ipv4Address, std::vector<MyprotocolHeader> > m_olderKeyframes;
+  /// node -> time a keyframe of it was last requested
+  std::map<Ipv4Address, Time> m_keyframeRequests;
+  /// number of position updates sent or relayed as deltas
+  TracedValue<uint32_t> m_deltaUpdatesSent;
+  /// number of received deltas whose keyframe was missing
+  TracedValue<uint32_t> m_keyframeMisses;
+
+  // ADD：根据邻居密度和控制信道负载调整更新阈值和最大更新间隔
+  bool m_adaptiveRate;
+  uint32_t m_targetNeighbors;           ///< neighbor count at which the rate is not scaled
+  double m_targetControlLoad;           ///< received update records per second at which the rate is not scaled
+  double m_minRateScale;                ///< lower bound of m_rateScale
+  double m_maxRateScale;                ///< upper bound of m_rateScale
+  uint32_t m_receivedRecords;           ///< update records received in the current measurement second
+  std::set<Ipv4Address> m_heardSenders; ///< neighbors heard in the current measurement second
+  double m_neighborEstimate;            ///< smoothed number of neighbors heard per second
+  double m_controlLoad;                 ///< smoothed number of update records received per second
+  /// the next measurement
+  EventId m_rateControlEvent;
+  /// factor applied to the update threshold and the maximum update interval
+  TracedValue<double> m_rateScale;
+
+  // ADD：按需位置服务，更新包只发给一跳邻居，需要时用扩展环搜索查询目的地的位置
+  bool m_onDemandLocation;
+  uint32_t m_locationTtlStart;          ///< TTL of the first location request
+  uint32_t m_locationTtlIncrement;      ///< TTL increment of each retry
+  uint32_t m_locationTtlThreshold;      ///< largest TTL before a network-wide request
+  /// A location query for a destination with queued packets
+  struct LocationQuery
+  {
+    uint32_t m_ttl;                     ///< TTL of the last request
+    EventId m_timeout;                  ///< the retry if no reply came
+  };
+  /// destination -> pending location query
+  std::map<Ipv4Address, LocationQuery> m_locationQueries;
+  /// id of the last location request sent
+  uint16_t m_locationRequestId;
+  /// location requests already processed
+  IdCache m_locationIdCache;
+  /// socket of the location replies, not bound to an interface and without the TTL of 1 of the control sockets
+  Ptr<Socket> m_replySocket;
+  /// number of location requests originated, retries included
+  TracedValue<uint32_t> m_locationRequestsSent;
+  /// number of location replies sent by targets and by nodes that knew the target
+  TracedValue<uint32_t> m_locationRepliesSent;
+
+  // ADD：同一仿真中的所有节点共享位置记录，每个表项只保存记录编号
+  bool m_sharedPositionStore;
 private:
   /// Start protocol operation
   void
@@ -145,6 +303,195 @@ private:
   void
   SendUpdate ();
 
+  /**
+   * Broadcast a position update on all interfaces
+   * \param header the update
+   */
+  void BroadcastUpdate (const MyprotocolHeader & header);
+  /**
+   * Broadcast position updates on all interfaces, concatenated into as few
+   * frames as the interface MTU allows
+   * \param headers the updates
+   */
+  void BroadcastUpdates (const std::vector<MyprotocolHeader> & headers);
+  /**
+   * Add a position update record in front of a control packet. If
+   * m_analysisInTags is set, the uid is left out of the record and carried
+   * in an AnalysisTag byte tag starting at the record. With delta beacons,
+   * an update newer or older than the stored keyframe of its node is added
+   * as a DeltaHeader when that is shorter.
+   * \param packet the control packet
+   * \param header the update
+   */
+  void AddUpdateRecord (Ptr<Packet> packet, MyprotocolHeader header);
+  /**
+   * Add a DataHeader in front of a data packet. If the header leaves out
+   * uid and error, they replace the AnalysisTag of the packet.
+   * \param packet the data packet
+   * \param dataHeader the header
+   */
+  void AddDataHeader (Ptr<Packet> packet, const DataHeader & dataHeader);
+  /**
+   * Remove the DataHeader from the front of a data packet. If the header
+   * left out uid and error, they are restored from the AnalysisTag.
+   * \param packet the data packet
+   * \param dataHeader the header (output)
+   */
+  void RemoveDataHeader (Ptr<Packet> packet, DataHeader & dataHeader);
+  /**
+   * Remove the DataHeader of a data packet for local delivery, wherever the
+   * transport protocol put it
+   * \param packet the data packet
+   * \param header the IP header
+   */
+  void StripDataHeader (Ptr<Packet> packet, const Ipv4Header & header);
+  /**
+   * Read the transport header and the DataHeader of a data packet without
+   * copying or changing the packet
+   * \param packet the data packet
+   * \param view the view, constructed with the transport header size (output)
+   * \returns the size of the chunk read
+   */
+  uint32_t PeekDataHeader (Ptr<const Packet> packet, DataHeaderView & view);
+  /**
+   * Replace the transport header and the DataHeader of a data packet by a view
+   * \param packet the data packet
+   * \param size the size of the chunk to replace, as returned by PeekDataHeader
+   * \param view the new headers
+   */
+  void RewriteDataHeader (Ptr<Packet> packet, uint32_t size, const DataHeaderView & view);
+  /**
+   * Replace the AnalysisTag of a data packet if its DataHeader leaves out uid and error
+   * \param packet the data packet
+   * \param dataHeader the header
+   */
+  void UpdateAnalysisTag (Ptr<Packet> packet, const DataHeader & dataHeader);
+  /**
+   * Restore uid and error of a DataHeader that left them out from the AnalysisTag
+   * \param packet the data packet
+   * \param dataHeader the header
+   */
+  void RestoreAnalysisFields (Ptr<const Packet> packet, DataHeader & dataHeader);
+  /**
+   * Process one position update record of a received control packet
+   * \param myprotocolHeader the update
+   * \param sender the neighbor it was received from
+   */
+  void RecvUpdate (MyprotocolHeader myprotocolHeader, Ipv4Address sender);
+  /**
+   * Route the queued data packets of a node after its position was learned
+   * \param myprotocolHeader the position update of the node
+   */
+  void SendQueuedPackets (const MyprotocolHeader & myprotocolHeader);
+  /**
+   * Keep a full update as the keyframe of its node. An update older than
+   * the newest keyframe is kept in a short history, so deltas of relays
+   * that hold an older keyframe, and the keyframes they send on request,
+   * can still be used.
+   * \param header the update
+   */
+  void StoreKeyframe (const MyprotocolHeader & header);
+  /**
+   * \param node the node
+   * \param timestamp the timestamp of the keyframe
+   * \param keyframe the keyframe (output)
+   * \returns true if the keyframe is the newest or in the history
+   */
+  bool FindKeyframe (Ipv4Address node, uint16_t timestamp, MyprotocolHeader & keyframe) const;
+  /**
+   * Decode a received delta update, or ask the neighbor that sent it for the
+   * missing keyframe
+   * \param delta the delta update
+   * \param socket the socket it was received on
+   * \param sender the neighbor it was received from
+   * \param header the decoded update (output)
+   * \returns true if the keyframe was known
+   */
+  bool DecodeDelta (const DeltaHeader & delta, Ptr<Socket> socket, Ipv4Address sender, MyprotocolHeader & header);
+  /**
+   * Answer a keyframe request with the stored keyframe, sent to the requester only
+   * \param request the request
+   * \param socket the socket it was received on
+   * \param sender the requester
+   */
+  void SendKeyframe (const KeyframeRequestHeader & request, Ptr<Socket> socket, Ipv4Address sender);
+  /**
+   * \returns the last position update this node sent, as its neighbors received it
+   */
+  MyprotocolHeader OwnRecord ();
+  /**
+   * Start an expanding ring search for the position of dst, unless one is running
+   * \param dst the destination of queued packets
+   */
+  void RequestLocation (Ipv4Address dst);
+  /**
+   * Originate a location request and schedule its timeout
+   * \param dst the node whose position is asked for
+   * \param ttl the number of hops the request may travel
+   */
+  void SendLocationRequest (Ipv4Address dst, uint32_t ttl);
+  /**
+   * No reply came within the ring traversal time: retry with a larger TTL,
+   * or drop the queued packets after a network-wide request
+   * \param dst the node whose position is asked for
+   */
+  void LocationRequestTimeout (Ipv4Address dst);
+  /**
+   * Broadcast a location request on all interfaces
+   * \param request the request
+   */
+  void BroadcastLocationRequest (const LocationRequestHeader & request);
+  /**
+   * Learn the position of the asking node, then reply if the target is this
+   * node or in the position table, or else relay the request
+   * \param request the request
+   */
+  void RecvLocationRequest (const LocationRequestHeader & request);
+  /**
+   * Unicast a position update to the node that asked for it. It is routed
+   * like a data packet, towards the position carried by the request.
+   * \param record the position update of the target
+   * \param origin the asking node
+   */
+  void SendLocationReply (MyprotocolHeader record, Ipv4Address origin);
+  /**
+   * Store the position of the target unless the table holds a newer one,
+   * end the location query and route the queued packets
+   * \param reply the reply
+   */
+  void RecvLocationReply (const LocationReplyHeader & reply);
+  /**
+   * Hold a new update for a random delay before deciding whether to
+   * rebroadcast it. If an older update of the same origin is still pending,
+   * it is replaced and the pending delay is kept.
+   * \param header the update
+   * \param sender the neighbor it was received from
+   */
+  void ScheduleRebroadcast (const MyprotocolHeader & header, Ipv4Address sender);
+  /**
+   * Account a duplicate copy of a pending update
+   * \param header the update
+   * \param sender the neighbor it was received from
+   */
+  void HeardRebroadcast (const MyprotocolHeader & header, Ipv4Address sender);
+  /**
+   * Rebroadcast the pending update of origin or suppress it according to m_rebroadcastScheme
+   * \param origin the node the update describes
+   */
+  void AssessRebroadcast (Ipv4Address origin);
+  /// Assess all pending updates and rebroadcast the accepted ones in one transmission
+  void FlushRebroadcasts ();
+  /**
+   * \param pending a pending update
+   * \returns true if m_rebroadcastScheme accepts the rebroadcast
+   */
+  bool ShouldRebroadcast (const PendingRebroadcast & pending);
+  /**
+   * \param sender a neighbor
+   * \returns the distance to the predicted position of sender, or the largest double if it is unknown
+   */
+  double DistanceToRelay (Ipv4Address sender);
+
   void SendPacketFromQueue (Ipv4Address dst, Ptr<Ipv4Route> route, DataHeader dataHeader);
 
   void
@@ -153,6 +500,46 @@ private:
   // ADD:定期检查速度、方向的变化
   void
   CheckChange ();
+  /**
+   * CourseChange trace sink of the node's MobilityModel: the motion the
+   * deadline was computed for has ended, compute it again
+   * \param mobility the mobility model
+   */
+  void CourseChanged (Ptr<const MobilityModel> mobility);
+  /**
+   * Schedule m_checkChangeTimer at the time the advertised prediction
+   * m_lastSendPos + m_lastSendVelocity * t drifts beyond
+   * UpdateThreshold () from the current motion, or at the maximum update
+   * interval if that comes first
+   */
+  void ScheduleKinematicCheck ();
+  /// Send the update whose deadline was computed by ScheduleKinematicCheck
+  void KinematicCheck ();
+  /**
+   * Close a one-second measurement of the neighbors heard and the update
+   * records received, and derive m_rateScale from the smoothed values
+   */
+  void UpdateRateScale ();
+  /**
+   * \returns the drift from the advertised trajectory that triggers an update, in meters
+   */
+  double UpdateThreshold () const;
+  /**
+   * \returns the longest time without an update, in seconds, kept short
+   *          enough that the entry of this node does not expire at its
+   *          neighbors before the next update
+   */
+  double MaxUpdateInterval () const;
+  /**
+   * \returns a new predictor of type m_predictorType
+   */
+  Ptr<MotionPredictor> CreatePredictor () const;
+  /**
+   * Position the neighbors predict for this node from its last update.
+   * \param t the time in seconds
+   * \returns the predicted position
+   */
+  Vector AdvertisedPosition (double t) const;
 
   // ADD:转换速度符号的两个函数。sign：记录速度是否为负数，0:都不是负数，1:X轴速度为负，2:Y轴速度为负，3:Z轴速度为负,4：xy为负数，5：xz为负数，6：yz为负数，7：全部都是负数
   Vector GetRightVelocity(uint16_t vx, uint16_t vy, uint16_t vz, uint16_t sign);
@@ -162,6 +549,18 @@ private:
   /// ADD： If route exists and valid, forward packet.
   bool Forwarding (Ptr<const Packet> p, const Ipv4Header & header, UnicastForwardCallback ucb, ErrorCallback ecb);
 
+  /**
+   * Greedy next hop towards dst, reusing the decision of an earlier packet
+   * to dst if it is still valid.
+   * \param dst the destination
+   * \param dstTimestamp timestamp of the destination entry
+   * \param myPos own position
+   * \param dstPos predicted destination position
+   * \param nextHop the chosen neighbor, zero for recovery mode (output)
+   * \returns the number of neighbors
+   */
+  uint32_t LookupNextHopCached (Ipv4Address dst, uint16_t dstTimestamp, Vector myPos, Vector dstPos, Ipv4Address & nextHop);
+
   // ADD:恢复模式
   Ipv4Address RecoveryMode(std::map<Ipv4Address, RoutingTableEntry> & neighborTable);
 
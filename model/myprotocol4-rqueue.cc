@@ -13,30 +13,28 @@ namespace myprotocol4 {
 uint32_t
 RequestQueue::GetSize ()
 {
-  Purge ();
   return m_queue.size ();
 }
 
 bool
 RequestQueue::Enqueue (QueueEntry & entry)
 {
-  Purge ();
-  for (std::vector<QueueEntry>::const_iterator i = m_queue.begin (); i
-       != m_queue.end (); ++i)
+  uint32_t dst = entry.GetIpv4Header ().GetDestination ().Get ();
+  UidDst key (entry.GetPacket ()->GetUid (), dst);
+  if (m_index.count (key))
     {
-      if ((i->GetPacket ()->GetUid () == entry.GetPacket ()->GetUid ())
-          && (i->GetIpv4Header ().GetDestination () == entry.GetIpv4Header ().GetDestination ()))
-        {
-          return false;
-        }
+      return false;
     }
   entry.SetExpireTime (m_queueTimeout);
   if (m_queue.size () == m_maxLen)
     {
       Drop (m_queue.front (), "Drop the most aged packet"); // Drop the most aged packet
-      m_queue.erase (m_queue.begin ());
+      Remove (m_queue.begin ());
     }
   m_queue.push_back (entry);
+  m_buckets[dst].push_back (--m_queue.end ());
+  m_index.insert (key);
+  ScheduleExpiry ();
   return true;
 }
 
@@ -44,47 +42,78 @@ void
 RequestQueue::DropPacketWithDst (Ipv4Address dst)
 {
   NS_LOG_FUNCTION (this << dst);
-  Purge ();
-  for (std::vector<QueueEntry>::iterator i = m_queue.begin (); i
-       != m_queue.end (); ++i)
+  std::unordered_map<uint32_t, std::deque<EntryIterator> >::iterator bucket = m_buckets.find (dst.Get ());
+  if (bucket == m_buckets.end ())
+    {
+      return;
+    }
+  std::deque<EntryIterator> entries;
+  entries.swap (bucket->second);
+  m_buckets.erase (bucket);
+  for (std::deque<EntryIterator>::iterator i = entries.begin (); i != entries.end (); ++i)
     {
-      if (IsEqual (*i, dst))
-        {
-          Drop (*i, "DropPacketWithDst ");
-        }
+      Drop (**i, "DropPacketWithDst ");
+      m_index.erase (UidDst ((*i)->GetPacket ()->GetUid (), dst.Get ()));
+      m_queue.erase (*i);
     }
-  m_queue.erase (std::remove_if (m_queue.begin (), m_queue.end (),
-                                 std::bind2nd (std::ptr_fun (RequestQueue::IsEqual), dst)), m_queue.end ());
+  ScheduleExpiry ();
 }
 
 bool
 RequestQueue::Dequeue (Ipv4Address dst, QueueEntry & entry)
 {
-  Purge ();
-  for (std::vector<QueueEntry>::iterator i = m_queue.begin (); i != m_queue.end (); ++i)
+  std::unordered_map<uint32_t, std::deque<EntryIterator> >::iterator bucket = m_buckets.find (dst.Get ());
+  if (bucket == m_buckets.end ())
+    {
+      return false;
+    }
+  EntryIterator i = bucket->second.front ();
+  entry = *i;
+  Remove (i);
+  ScheduleExpiry ();
+  return true;
+}
+
+uint32_t
+RequestQueue::DequeueAll (Ipv4Address dst, std::vector<QueueEntry> & entries)
+{
+  std::unordered_map<uint32_t, std::deque<EntryIterator> >::iterator bucket = m_buckets.find (dst.Get ());
+  if (bucket == m_buckets.end ())
+    {
+      return 0;
+    }
+  uint32_t n = bucket->second.size ();
+  entries.reserve (entries.size () + n);
+  for (std::deque<EntryIterator>::iterator i = bucket->second.begin (); i != bucket->second.end (); ++i)
     {
-      if (i->GetIpv4Header ().GetDestination () == dst)
-        {
-          entry = *i;
-          m_queue.erase (i);
-          return true;
-        }
+      entries.push_back (**i);
+      m_index.erase (UidDst ((*i)->GetPacket ()->GetUid (), dst.Get ()));
+      m_queue.erase (*i);
     }
-  return false;
+  m_buckets.erase (bucket);
+  ScheduleExpiry ();
+  return n;
 }
 
 bool
 RequestQueue::Find (Ipv4Address dst)
 {
-  for (std::vector<QueueEntry>::const_iterator i = m_queue.begin (); i
-       != m_queue.end (); ++i)
+  return m_buckets.find (dst.Get ()) != m_buckets.end ();
+}
+
+void
+RequestQueue::Remove (EntryIterator i)
+{
+  uint32_t dst = i->GetIpv4Header ().GetDestination ().Get ();
+  std::unordered_map<uint32_t, std::deque<EntryIterator> >::iterator bucket = m_buckets.find (dst);
+  NS_ASSERT (bucket != m_buckets.end () && bucket->second.front () == i);
+  bucket->second.pop_front ();
+  if (bucket->second.empty ())
     {
-      if (i->GetIpv4Header ().GetDestination () == dst)
-        {
-          return true;
-        }
+      m_buckets.erase (bucket);
     }
-  return false;
+  m_index.erase (UidDst (i->GetPacket ()->GetUid (), dst));
+  m_queue.erase (i);
 }
 
 struct IsExpired
@@ -92,24 +121,45 @@ struct IsExpired
   bool
   operator() (QueueEntry const & e) const
   {
-    return (e.GetExpireTime () < Seconds (0));
+    return (e.GetExpireTime () <= Seconds (0));
   }
 };
 
 void
 RequestQueue::Purge ()
 {
+  // 所有表项的超时时间相同，按入队顺序过期，只需检查队首
   IsExpired pred;
-  for (std::vector<QueueEntry>::iterator i = m_queue.begin (); i
-       != m_queue.end (); ++i)
+  while (!m_queue.empty () && pred (m_queue.front ()))
+    {
+      Drop (m_queue.front (), "Drop outdated packet ");
+      Remove (m_queue.begin ());
+    }
+}
+
+void
+RequestQueue::Expire ()
+{
+  Purge ();
+  ScheduleExpiry ();
+}
+
+void
+RequestQueue::ScheduleExpiry ()
+{
+  if (m_queue.empty ())
+    {
+      m_expiryTimer.Cancel ();
+      return;
+    }
+  Time delay = m_queue.front ().GetExpireTime ();
+  if (m_expiryTimer.IsRunning () && m_expiryTime == Simulator::Now () + delay)
     {
-      if (pred (*i))
-        {
-          Drop (*i, "Drop outdated packet ");
-        }
+      return;
     }
-  m_queue.erase (std::remove_if (m_queue.begin (), m_queue.end (), pred),
-                 m_queue.end ());
+  m_expiryTimer.Cancel ();
+  m_expiryTime = Simulator::Now () + delay;
+  m_expiryTimer.Schedule (delay > Seconds (0) ? delay : Seconds (0));
 }
 
 void
@@ -2,8 +2,14 @@
 #define MYPROTOCOL4_RQUEUE_H
 
 #include <vector>
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
 #include "ns3/ipv4-routing-protocol.h"
 #include "ns3/simulator.h"
+#include "ns3/timer.h"
 
 
 namespace ns3 {
@@ -131,8 +137,10 @@ class RequestQueue
 public:
   RequestQueue (uint32_t maxLen, Time routeToQueueTimeout)
     : m_maxLen (maxLen),
-      m_queueTimeout (routeToQueueTimeout)
+      m_queueTimeout (routeToQueueTimeout),
+      m_expiryTimer (Timer::CANCEL_ON_DESTROY)
   {
+    m_expiryTimer.SetFunction (&RequestQueue::Expire, this);
   }
   /**
    * Push entry in queue, if there is no entry with the same packet and destination address in queue.
@@ -148,6 +156,14 @@ public:
    * \returns true if the entry is dequeued
    */
   bool Dequeue (Ipv4Address dst, QueueEntry & entry);
+  /**
+   * Remove all entries for given destination at once, the earliest first
+   *
+   * \param dst the destination IP address
+   * \param entries the dequeued entries are appended here
+   * \returns the number of dequeued entries
+   */
+  uint32_t DequeueAll (Ipv4Address dst, std::vector<QueueEntry> & entries);
   /**
    * Remove all packets with destination IP address dst
    * \param dst the destination IP address
@@ -200,10 +216,39 @@ public:
   }
 
 private:
-  /// The queue
-  std::vector<QueueEntry> m_queue;
+  /// Position of an entry in m_queue
+  typedef std::list<QueueEntry>::iterator EntryIterator;
+  /// Queued (packet uid, destination address) pair
+  typedef std::pair<uint64_t, uint32_t> UidDst;
+  /// Hash of a UidDst
+  struct UidDstHash
+  {
+    size_t operator() (const UidDst & k) const
+    {
+      return std::hash<uint64_t> () ((k.first << 32) ^ k.first ^ k.second);
+    }
+  };
+  /// The queue, ordered by age with the oldest entry first
+  std::list<QueueEntry> m_queue;
+  /**
+   * Destination address -> entries for it in m_queue, ordered by age. The
+   * globally oldest entry is also the oldest of its destination, so entries
+   * are only ever removed from the front of a bucket.
+   */
+  std::unordered_map<uint32_t, std::deque<EntryIterator> > m_buckets;
+  /// Index of the queued (packet uid, destination) pairs, for duplicate detection
+  std::unordered_set<UidDst, UidDstHash> m_index;
+  /**
+   * Remove the entry at i, which must be the oldest entry of its destination.
+   * \param i the entry
+   */
+  void Remove (EntryIterator i);
   /// Remove all expired entries
   void Purge ();
+  /// Drop the expired entries when the oldest entry reaches its deadline
+  void Expire ();
+  /// Schedule m_expiryTimer for the deadline of the oldest entry, if it changed
+  void ScheduleExpiry ();
   /**
    * Notify that packet is dropped from queue by timeout
    * \param en the queue entry to drop
@@ -215,15 +260,13 @@ private:
   /// The maximum period of time that a routing protocol is allowed to buffer a packet for, seconds.
   Time m_queueTimeout;
   /**
-   * Determine if queue matches a destination address
-   * \param en The queue entry
-   * \param dst The destination IPv4 address
-   * \returns true if the queue entry matches the desination address
+   * Fires at the deadline of the oldest entry. Entries expire in age order,
+   * so one pending event is enough and the other calls never scan for
+   * expired entries.
    */
-  static bool IsEqual (QueueEntry en, const Ipv4Address dst)
-  {
-    return (en.GetIpv4Header ().GetDestination () == dst);
-  }
+  Timer m_expiryTimer;
+  /// Absolute deadline m_expiryTimer is scheduled for
+  Time m_expiryTime;
 };
 
 
@@ -1,6 +1,9 @@
 #include "myprotocol4-rtable.h"
+#include "myprotocol4-predict-kernel.h"
 #include "ns3/simulator.h"
 #include <iomanip>
+#include <algorithm>
+#include <cmath>
 #include "ns3/log.h"
 
 namespace ns3 {
@@ -32,60 +35,134 @@ RoutingTableEntry::~RoutingTableEntry ()
 }
 
 
+const uint32_t RoutingTable::EMPTY_SLOT;
+const uint32_t RoutingTable::NOT_INDEXED;
+
+/// number of grid cell entries handed to the range kernel at once
+static const uint32_t RANGE_CHUNK = 64;
+/// margin of the memoized neighbor candidates, as a fraction of the transmission range
+static const double NEARBY_MARGIN = 0.1;
+
 RoutingTable::RoutingTable ()
+  : m_slots (16, EMPTY_SLOT),
+    m_purgeGranularity (1),
+    m_wheelTime (-1),
+    m_transRange (250),
+    m_gridTime (-1),
+    m_nearbyTime (-1),
+    m_nearbyVersion (0)
+{
+  m_minLifeTime = 30;
+  m_maxLifeTime = 30;
+  m_errorBudget = 0;
+  SetPurgeGranularity (1);
+}
+
+RoutingTable::~RoutingTable ()
 {
-  m_entryLifeTime = 30;
+  Clear ();
 }
 
 bool
 RoutingTable::LookupRoute (Ipv4Address id,
                            RoutingTableEntry & rt)
 {
-  if (m_positionTable.empty ())
+  int32_t i = Find (id);
+  if (i < 0)
     {
       return false;
     }
-  std::map<Ipv4Address, RoutingTableEntry>::const_iterator i = m_positionTable.find (id);
-  if (i == m_positionTable.end ())
-    {
-      return false;
-    }
-  rt = i->second;
+  rt = GetEntry (i);
   return true;
 }
 
 bool
 RoutingTable::DeleteRoute (Ipv4Address dst)
 {
-  if (m_positionTable.erase (dst) != 0)
+  int32_t i = Find (dst);
+  if (i < 0)
     {
-      // NS_LOG_DEBUG("Route erased");
-      return true;
+      return false;
     }
-  return false;
+  Erase (i);
+  return true;
 }
 
 bool
 RoutingTable::AddRoute (RoutingTableEntry & rt)
 {
-  std::pair<std::map<Ipv4Address, RoutingTableEntry>::iterator, bool> result = m_positionTable.insert (std::make_pair (
-                                                                                                            rt.GetAdress (),rt));
-  return result.second;
+  if (Find (rt.GetAdress ()) >= 0)
+    {
+      return false;
+    }
+  Insert (rt);
+  return true;
 }
 
 bool
 RoutingTable::Update (RoutingTableEntry & rt)
 {
-  std::map<Ipv4Address, RoutingTableEntry>::iterator i = m_positionTable.find (rt.GetAdress ());
-  if (i == m_positionTable.end ())
+  int32_t i = Find (rt.GetAdress ());
+  if (i < 0)
     {
-      AddRoute(rt);
+      Insert (rt);
     }else{
-      i->second = rt;
+      uint16_t timestamp = GetRecord (i).m_timestamp;
+      int64_t deadline = ScheduledDeadline (i);
+      SetEntry (i, rt);
+      if (rt.GetTimestamp () != timestamp)
+        {
+          ObserveEntry (i);
+        }
+      UnindexEntry (i);
+      IndexEntry (i);
+      // 时间戳或速度改变都会改变过期时间
+      if (EntryDeadline (i) != deadline)
+        {
+          ScheduleExpiry (i);
+        }
     }
   return true;
 }
 
+void
+RoutingTable::Clear ()
+{
+  m_addr.clear ();
+  m_x.clear ();
+  m_y.clear ();
+  m_z.clear ();
+  m_vx.clear ();
+  m_vy.clear ();
+  m_vz.clear ();
+  m_timestamp.clear ();
+  for (uint32_t i = 0; i < m_record.size (); ++i)
+    {
+      m_store->Release (m_record[i]);
+    }
+  m_record.clear ();
+  m_deadline.clear ();
+  m_cell.clear ();
+  m_predX.clear ();
+  m_predY.clear ();
+  m_predZ.clear ();
+  std::fill (m_slots.begin (), m_slots.end (), EMPTY_SLOT);
+  m_grid.clear ();
+  m_gridTime = -1;
+  m_nearby.Clear ();
+  m_nearbyTime = -1;
+  m_nearbyVersion++;
+  for (uint32_t k = 0; k < m_wheel.size (); ++k)
+    {
+      m_wheel[k].clear ();
+    }
+  m_overdue.clear ();
+  if (m_predictor != 0)
+    {
+      m_predictor->Clear ();
+    }
+}
+
 void
 RoutingTableEntry::Print (Ptr<OutputStreamWrapper> stream) const
 {
@@ -93,14 +170,32 @@ RoutingTableEntry::Print (Ptr<OutputStreamWrapper> stream) const
                         << m_vx << "\t\t" << m_vy << "\t\t" << m_vz << "\t\t" << m_timestamp << "\t\t" << m_adress << "\n";
 }
 
+struct AddressOrder
+{
+  AddressOrder (const std::vector<uint32_t> & addr) : m_addr (addr)
+  {
+  }
+  bool operator() (uint32_t a, uint32_t b) const
+  {
+    return m_addr[a] < m_addr[b];
+  }
+  const std::vector<uint32_t> & m_addr;
+};
+
 void
 RoutingTable::Print (Ptr<OutputStreamWrapper> stream) const
 {
   *stream->GetStream () << "\n myprotocol Routing table\n" << "x\t\ty\t\tz\t\tvx\t\tvy\t\tvz\t\ttimestamp\t\tadress\n";
-  for (std::map<Ipv4Address, RoutingTableEntry>::const_iterator i = m_positionTable.begin (); i
-       != m_positionTable.end (); ++i)
+  // 按地址顺序打印，与之前基于map的输出保持一致
+  std::vector<uint32_t> order (m_addr.size ());
+  for (uint32_t i = 0; i < order.size (); ++i)
     {
-      i->second.Print (stream);
+      order[i] = i;
+    }
+  std::sort (order.begin (), order.end (), AddressOrder (m_addr));
+  for (std::vector<uint32_t>::const_iterator i = order.begin (); i != order.end (); ++i)
+    {
+      GetEntry (*i).Print (stream);
     }
   *stream->GetStream () << "\n";
 }
@@ -108,41 +203,56 @@ RoutingTable::Print (Ptr<OutputStreamWrapper> stream) const
 // ADD:位置预测函数
 Vector 
 RoutingTable::PredictPosition(Ipv4Address id){
-  RoutingTableEntry rt;
-  if(!LookupRoute(id,rt)){
+  int32_t i = Find (id);
+  if(i < 0){
     std::cout<<"not find a valid routing entry!!!\n";
     return Vector(-1,-1,-1);
-  }else{
-    // 先获取该节点的速度、位置、时间戳
-    uint16_t deltaTime = Simulator::Now ().ToInteger(Time::S) - rt.GetTimestamp();
-    int16_t tempX = rt.GetX() + deltaTime * rt.GetVx();
-    int16_t tempY = rt.GetY() + deltaTime * rt.GetVy();
-    int16_t tempZ = rt.GetZ() + deltaTime * rt.GetVz();
-    uint16_t newX = tempX > 0 ? tempX : 0;
-    uint16_t newY = tempY > 0 ? tempY : 0;
-    uint16_t newZ = tempZ > 0 ? tempZ : 0;
-    uint16_t maxX = 1000;
-    uint16_t maxY = 1000;
-    uint16_t maxZ = 300;
-    newX = newX > maxX ? maxX : newX;
-    newY = newY > maxY ? maxY : newY;
-    newZ = newZ > maxZ ? maxZ : newZ;
-    return Vector(newX, newY, newZ);
   }
+  // 同一秒内的预测结果已缓存
+  RefreshGrid ();
+  return Vector (m_predX[i], m_predY[i], m_predZ[i]);
+}
+
+Vector
+RoutingTable::PredictEntry (uint32_t i, int64_t now) const
+{
+  PositionRecord r = GetRecord (i);
+  if (!IsConstantVelocity ())
+    {
+      Vector pos = m_predictor->Predict (r.m_addr, Vector (r.m_x, r.m_y, r.m_z),
+                                         Vector (r.m_vx, r.m_vy, r.m_vz), r.m_timestamp, now);
+      return Vector ((uint16_t) std::min (std::max (pos.x, 0.0), (double) PREDICT_MAX_X),
+                     (uint16_t) std::min (std::max (pos.y, 0.0), (double) PREDICT_MAX_Y),
+                     (uint16_t) std::min (std::max (pos.z, 0.0), (double) PREDICT_MAX_Z));
+    }
+  // 先获取该节点的速度、位置、时间戳
+  uint16_t deltaTime = now - r.m_timestamp;
+  int16_t tempX = r.m_x + deltaTime * r.m_vx;
+  int16_t tempY = r.m_y + deltaTime * r.m_vy;
+  int16_t tempZ = r.m_z + deltaTime * r.m_vz;
+  uint16_t newX = tempX > 0 ? tempX : 0;
+  uint16_t newY = tempY > 0 ? tempY : 0;
+  uint16_t newZ = tempZ > 0 ? tempZ : 0;
+  uint16_t maxX = 1000;
+  uint16_t maxY = 1000;
+  uint16_t maxZ = 300;
+  newX = newX > maxX ? maxX : newX;
+  newY = newY > maxY ? maxY : newY;
+  newZ = newZ > maxZ ? maxZ : newZ;
+  return Vector(newX, newY, newZ);
 }
 
 // ADD：筛选邻居节点
 void 
 RoutingTable::LookupNeighbor(std::map<Ipv4Address, RoutingTableEntry> & neighborTable, Vector myPos){
-  uint16_t TransmissionRange = 250;
-  for (std::map<Ipv4Address, RoutingTableEntry>::iterator i = m_positionTable.begin (); i != m_positionTable.end (); i++){
-    if(i->first == Ipv4Address::GetLoopback () || i->first == Ipv4Address("10.1.1.255") || i->first == Ipv4Address("255.255.255.255")){
-      continue;
-    }
-    Vector predictPos = PredictPosition(i->first);
-    double distance = CalculateDistance(predictPos, myPos);
-    if(distance <= TransmissionRange){
-      neighborTable.insert(std::make_pair(i->first,i->second));
+  const GridCell & c = NearbyEntries (myPos);
+  uint32_t hits[RANGE_CHUNK];
+  for (uint32_t base = 0; base < c.m_entry.size (); base += RANGE_CHUNK){
+    uint32_t n = std::min<uint32_t> (RANGE_CHUNK, c.m_entry.size () - base);
+    uint32_t found = WithinRangeBatch (&c.m_px[base], &c.m_py[base], &c.m_pz[base], n, myPos, m_transRange, hits);
+    for (uint32_t k = 0; k < found; k++){
+      uint32_t i = c.m_entry[base + hits[k]];
+      neighborTable.insert(std::make_pair (Ipv4Address (m_addr[i]), GetEntry (i)));
     }
   }
 }
@@ -178,25 +288,711 @@ RoutingTable::BestNeighbor (std::map<Ipv4Address, RoutingTableEntry> neighborTab
   }
 }
 
+uint32_t
+RoutingTable::LookupNextHop (Vector myPos, Vector dstPos, Ipv4Address & nextHop)
+{
+  return FindNextHop (myPos, dstPos, nextHop, 0);
+}
+
+uint32_t
+RoutingTable::LookupNextHop (Vector myPos, Vector dstPos, Ipv4Address & nextHop, double & stable)
+{
+  return FindNextHop (myPos, dstPos, nextHop, &stable);
+}
+
+uint32_t
+RoutingTable::FindNextHop (Vector myPos, Vector dstPos, Ipv4Address & nextHop, double *stable)
+{
+  const GridCell & c = NearbyEntries (myPos);
+  uint32_t neighbors = 0;
+  uint32_t hits[RANGE_CHUNK];
+  uint32_t bestFoundID = 0;
+  double bestFoundDistance = 0;
+  for (uint32_t base = 0; base < c.m_entry.size (); base += RANGE_CHUNK)
+    {
+      uint32_t n = std::min<uint32_t> (RANGE_CHUNK, c.m_entry.size () - base);
+      uint32_t found = WithinRangeBatch (&c.m_px[base], &c.m_py[base], &c.m_pz[base], n, myPos, m_transRange, hits);
+      for (uint32_t k = 0; k < found; k++)
+        {
+          uint32_t j = base + hits[k];
+          uint32_t addr = m_addr[c.m_entry[j]];
+          // 距离相同时取地址较小者，与BestNeighbor按map顺序遍历的结果一致
+          double distance = CalculateDistance (Vector (c.m_px[j], c.m_py[j], c.m_pz[j]), dstPos);
+          if (neighbors == 0 || distance < bestFoundDistance
+              || (distance == bestFoundDistance && addr < bestFoundID))
+            {
+              bestFoundID = addr;
+              bestFoundDistance = distance;
+            }
+          neighbors++;
+        }
+    }
+
+  if (stable)
+    {
+      // 邻居集合在任何候选表项跨过通信范围边界或者移出候选范围之前保持不变，
+      // 最优邻居只取决于dstPos，剩下的只有“是否比自己更近”的比较
+      *stable = m_transRange * NEARBY_MARGIN - CalculateDistance (myPos, m_nearbyAnchor);
+      for (uint32_t j = 0; j < c.m_entry.size (); j++)
+        {
+          double d = CalculateDistance (Vector (c.m_px[j], c.m_py[j], c.m_pz[j]), myPos);
+          *stable = std::min (*stable, std::fabs (d - m_transRange));
+        }
+      if (neighbors > 0)
+        {
+          *stable = std::min (*stable, std::fabs (CalculateDistance (dstPos, myPos) - bestFoundDistance));
+        }
+    }
+
+  nextHop = Ipv4Address::GetZero ();
+  if (neighbors == 0)
+    {
+      return 0;
+    }
+  if (CalculateDistance (dstPos, myPos) > bestFoundDistance)
+    {
+      nextHop = Ipv4Address (bestFoundID);
+    }
+  else
+    {
+      std::cout<<"There is no closer neighbor!!!\n";
+    }
+  return neighbors;
+}
+
 // ADD：清理过期表项
 void
 RoutingTable::Purge(){
-  if (m_positionTable.empty ())
-  {
+  int64_t now = Simulator::Now ().ToInteger(Time::S);
+  if (!m_overdue.empty ()){
+    std::vector<Expiry> overdue;
+    overdue.swap (m_overdue);
+    for (std::vector<Expiry>::const_iterator e = overdue.begin (); e != overdue.end (); ++e){
+      Expire (*e, now);
+    }
+  }
+  // 只处理截止时间已经全部到期、且尚未处理过的桶；同一秒内再次调用时直接返回
+  int64_t last = (now + 1) / m_purgeGranularity - 1;
+  int64_t next = (m_wheelTime + 1) / m_purgeGranularity;
+  if (now <= m_wheelTime || last < next){
     return;
   }
-
-  for (std::map<Ipv4Address, RoutingTableEntry>::iterator i = m_positionTable.begin (); i != m_positionTable.end (); ){
-    if (m_entryLifeTime + i->second.GetTimestamp() <= Simulator::Now ().ToInteger(Time::S)){
-      std::map<Ipv4Address, RoutingTableEntry>::iterator itmp = i;
-      ++i;
-      m_positionTable.erase (itmp);
-    }else{
-      ++i;
+  // 超过一圈未处理时，每个槽位只需处理一次
+  int64_t first = std::max<int64_t> (next, last - (int64_t) m_wheel.size () + 1);
+  for (int64_t k = first; k <= last; ++k){
+    std::vector<Expiry> bucket;
+    bucket.swap (m_wheel[k & (m_wheel.size () - 1)]);
+    for (std::vector<Expiry>::const_iterator e = bucket.begin (); e != bucket.end (); ++e){
+      Expire (*e, now);
     }
   }
+  m_wheelTime = now;
   return;
 }
 
+void
+RoutingTable::SetPurgeGranularity (uint16_t granularity)
+{
+  m_purgeGranularity = granularity > 0 ? granularity : 1;
+  // 槽位数量覆盖一个完整的表项生命周期
+  uint32_t slots = 1;
+  while (slots < (uint32_t) m_maxLifeTime / m_purgeGranularity + 2)
+    {
+      slots *= 2;
+    }
+  m_wheel.assign (slots, std::vector<Expiry> ());
+  m_overdue.clear ();
+  for (uint32_t i = 0; i < m_addr.size (); ++i)
+    {
+      ScheduleExpiry (i);
+    }
+}
+
+void
+RoutingTable::SetEntryLifeTime (double errorBudget, uint16_t minLifeTime, uint16_t maxLifeTime)
+{
+  m_errorBudget = errorBudget;
+  m_maxLifeTime = maxLifeTime;
+  m_minLifeTime = std::min (minLifeTime, maxLifeTime);
+  // 重新建立时间轮，所有表项按新的过期时间调度，已经过期的在下一次Purge时删除
+  SetPurgeGranularity (m_purgeGranularity);
+}
+
+void
+RoutingTable::SetPositionStore (Ptr<PositionStore> store)
+{
+  if (store == m_store)
+    {
+      return;
+    }
+  // 把已有表项的记录搬到新的存储位置
+  uint32_t n = m_addr.size ();
+  std::vector<PositionRecord> records (n);
+  for (uint32_t i = 0; i < n; ++i)
+    {
+      records[i] = GetRecord (i);
+      if (m_store != 0)
+        {
+          m_store->Release (m_record[i]);
+        }
+    }
+  m_x.clear ();
+  m_y.clear ();
+  m_z.clear ();
+  m_vx.clear ();
+  m_vy.clear ();
+  m_vz.clear ();
+  m_timestamp.clear ();
+  m_deadline.clear ();
+  m_record.clear ();
+  m_store = store;
+  for (uint32_t i = 0; i < n; ++i)
+    {
+      const PositionRecord & r = records[i];
+      if (m_store != 0)
+        {
+          m_record.push_back (m_store->Intern (r));
+        }
+      else
+        {
+          m_x.push_back (r.m_x);
+          m_y.push_back (r.m_y);
+          m_z.push_back (r.m_z);
+          m_vx.push_back (r.m_vx);
+          m_vy.push_back (r.m_vy);
+          m_vz.push_back (r.m_vz);
+          m_timestamp.push_back (r.m_timestamp);
+          m_deadline.push_back (0);
+          // 时间轮中的过期时间就是由记录算出的过期时间
+          m_deadline[i] = EntryDeadline (i);
+        }
+    }
+}
+
+int64_t
+RoutingTable::EntryDeadline (uint32_t i) const
+{
+  PositionRecord r = GetRecord (i);
+  uint16_t lifeTime = m_maxLifeTime;
+  if (m_errorBudget > 0)
+    {
+      double speed = std::sqrt ((double) r.m_vx * r.m_vx + (double) r.m_vy * r.m_vy + (double) r.m_vz * r.m_vz);
+      if (speed * m_maxLifeTime > m_errorBudget)
+        {
+          lifeTime = std::max<uint16_t> (m_minLifeTime, m_errorBudget / speed);
+        }
+    }
+  return (int64_t) r.m_timestamp + lifeTime;
+}
+
+int64_t
+RoutingTable::ScheduledDeadline (uint32_t i) const
+{
+  // 共享存储中的记录不可修改，表项的过期时间总是由当前记录算出的
+  return m_store != 0 ? EntryDeadline (i) : m_deadline[i];
+}
+
+void
+RoutingTable::ScheduleExpiry (uint32_t i)
+{
+  Expiry e;
+  e.m_addr = m_addr[i];
+  e.m_deadline = EntryDeadline (i);
+  if (m_store == 0)
+    {
+      m_deadline[i] = e.m_deadline;
+    }
+  ScheduleExpiry (e);
+}
+
+void
+RoutingTable::ScheduleExpiry (const Expiry & e)
+{
+  int64_t bucket = std::max<int64_t> (e.m_deadline, 0) / m_purgeGranularity;
+  if (bucket < (m_wheelTime + 1) / m_purgeGranularity)
+    {
+      m_overdue.push_back (e);
+    }
+  else
+    {
+      m_wheel[bucket & (m_wheel.size () - 1)].push_back (e);
+    }
+}
+
+void
+RoutingTable::Expire (const Expiry & e, int64_t now)
+{
+  int32_t i = Find (Ipv4Address (e.m_addr));
+  if (i < 0 || ScheduledDeadline (i) != e.m_deadline)
+    {
+      return;
+    }
+  if (e.m_deadline <= now)
+    {
+      Erase (i);
+    }
+  else
+    {
+      ScheduleExpiry (e);
+    }
+}
+
+bool
+RoutingTable::IsNeighborCandidate (Ipv4Address id)
+{
+  return !(id == Ipv4Address::GetLoopback () || id == Ipv4Address("10.1.1.255") || id == Ipv4Address("255.255.255.255"));
+}
+
+uint32_t
+RoutingTable::HomeSlot (uint32_t key) const
+{
+  // Fibonacci哈希，地址的低位通常是连续分配的
+  return (key * 2654435769u) & (m_slots.size () - 1);
+}
+
+uint32_t
+RoutingTable::FindSlot (uint32_t key) const
+{
+  uint32_t mask = m_slots.size () - 1;
+  uint32_t s = HomeSlot (key);
+  while (m_slots[s] != EMPTY_SLOT && m_addr[m_slots[s] - 1] != key)
+    {
+      s = (s + 1) & mask;
+    }
+  return s;
+}
+
+int32_t
+RoutingTable::Find (Ipv4Address id) const
+{
+  uint32_t slot = m_slots[FindSlot (id.Get ())];
+  return slot == EMPTY_SLOT ? -1 : (int32_t)(slot - 1);
+}
+
+uint32_t
+RoutingTable::Insert (const RoutingTableEntry & rt)
+{
+  if (2 * (m_addr.size () + 1) > m_slots.size ())
+    {
+      Rehash (2 * m_slots.size ());
+    }
+  uint32_t i = m_addr.size ();
+  m_addr.push_back (rt.GetAdress ().Get ());
+  if (m_store != 0)
+    {
+      PositionRecord r = { m_addr[i], rt.GetX (), rt.GetY (), rt.GetZ (),
+                           rt.GetVx (), rt.GetVy (), rt.GetVz (), rt.GetTimestamp () };
+      m_record.push_back (m_store->Intern (r));
+    }
+  else
+    {
+      m_x.push_back (0);
+      m_y.push_back (0);
+      m_z.push_back (0);
+      m_vx.push_back (0);
+      m_vy.push_back (0);
+      m_vz.push_back (0);
+      m_timestamp.push_back (0);
+      m_deadline.push_back (0);
+    }
+  m_cell.push_back (NOT_INDEXED);
+  m_predX.push_back (0);
+  m_predY.push_back (0);
+  m_predZ.push_back (0);
+  SetEntry (i, rt);
+  m_slots[FindSlot (m_addr[i])] = i + 1;
+  ObserveEntry (i);
+  IndexEntry (i);
+  ScheduleExpiry (i);
+  return i;
+}
+
+void
+RoutingTable::Erase (uint32_t i)
+{
+  UnindexEntry (i);
+  if (m_predictor != 0)
+    {
+      m_predictor->Forget (m_addr[i]);
+    }
+
+  // 线性探测的删除：把后面属于该位置之前的表项向前移动，避免使用墓碑
+  uint32_t mask = m_slots.size () - 1;
+  uint32_t hole = FindSlot (m_addr[i]);
+  uint32_t s = (hole + 1) & mask;
+  while (m_slots[s] != EMPTY_SLOT)
+    {
+      uint32_t home = HomeSlot (m_addr[m_slots[s] - 1]);
+      if (((s - home) & mask) >= ((s - hole) & mask))
+        {
+          m_slots[hole] = m_slots[s];
+          hole = s;
+        }
+      s = (s + 1) & mask;
+    }
+  m_slots[hole] = EMPTY_SLOT;
+  if (m_store != 0)
+    {
+      m_store->Release (m_record[i]);
+    }
+
+  uint32_t last = m_addr.size () - 1;
+  if (i != last)
+    {
+      m_addr[i] = m_addr[last];
+      if (m_store != 0)
+        {
+          m_record[i] = m_record[last];
+        }
+      else
+        {
+          m_x[i] = m_x[last];
+          m_y[i] = m_y[last];
+          m_z[i] = m_z[last];
+          m_vx[i] = m_vx[last];
+          m_vy[i] = m_vy[last];
+          m_vz[i] = m_vz[last];
+          m_timestamp[i] = m_timestamp[last];
+          m_deadline[i] = m_deadline[last];
+        }
+      m_cell[i] = m_cell[last];
+      m_predX[i] = m_predX[last];
+      m_predY[i] = m_predY[last];
+      m_predZ[i] = m_predZ[last];
+      m_slots[FindSlot (m_addr[i])] = i + 1;
+      if (m_cell[i] != NOT_INDEXED)
+        {
+          m_grid[m_cell[i]].Renumber (last, i);
+          if (m_nearbyTime >= 0)
+            {
+              m_nearby.Renumber (last, i);
+            }
+        }
+    }
+  m_addr.pop_back ();
+  if (m_store != 0)
+    {
+      m_record.pop_back ();
+    }
+  else
+    {
+      m_x.pop_back ();
+      m_y.pop_back ();
+      m_z.pop_back ();
+      m_vx.pop_back ();
+      m_vy.pop_back ();
+      m_vz.pop_back ();
+      m_timestamp.pop_back ();
+      m_deadline.pop_back ();
+    }
+  m_cell.pop_back ();
+  m_predX.pop_back ();
+  m_predY.pop_back ();
+  m_predZ.pop_back ();
+}
+
+/// \returns the bytes allocated by the elements of v
+template <typename T>
+static uint64_t
+VectorBytes (const std::vector<T> & v)
+{
+  return v.capacity () * sizeof (T);
+}
+
+uint64_t
+RoutingTable::GetMemoryUsage () const
+{
+  uint64_t bytes = VectorBytes (m_addr) + VectorBytes (m_x) + VectorBytes (m_y) + VectorBytes (m_z)
+    + VectorBytes (m_vx) + VectorBytes (m_vy) + VectorBytes (m_vz) + VectorBytes (m_timestamp)
+    + VectorBytes (m_record) + VectorBytes (m_deadline) + VectorBytes (m_slots) + VectorBytes (m_cell)
+    + VectorBytes (m_predX) + VectorBytes (m_predY) + VectorBytes (m_predZ)
+    + VectorBytes (m_wheel) + VectorBytes (m_overdue);
+  for (uint32_t k = 0; k < m_wheel.size (); ++k)
+    {
+      bytes += VectorBytes (m_wheel[k]);
+    }
+  // 红黑树每个节点有三个指针和颜色
+  for (std::map<uint32_t, GridCell>::const_iterator c = m_grid.begin (); c != m_grid.end (); ++c)
+    {
+      bytes += sizeof (std::pair<const uint32_t, GridCell>) + 4 * sizeof (void *)
+        + VectorBytes (c->second.m_entry) + VectorBytes (c->second.m_px)
+        + VectorBytes (c->second.m_py) + VectorBytes (c->second.m_pz);
+    }
+  bytes += VectorBytes (m_nearby.m_entry) + VectorBytes (m_nearby.m_px)
+    + VectorBytes (m_nearby.m_py) + VectorBytes (m_nearby.m_pz);
+  return bytes;
+}
+
+void
+RoutingTable::Rehash (uint32_t capacity)
+{
+  m_slots.assign (capacity, EMPTY_SLOT);
+  for (uint32_t i = 0; i < m_addr.size (); ++i)
+    {
+      m_slots[FindSlot (m_addr[i])] = i + 1;
+    }
+}
+
+void
+RoutingTable::ObserveEntry (uint32_t i)
+{
+  if (m_predictor != 0)
+    {
+      PositionRecord r = GetRecord (i);
+      m_predictor->Observe (r.m_addr, Vector (r.m_x, r.m_y, r.m_z),
+                            Vector (r.m_vx, r.m_vy, r.m_vz), r.m_timestamp);
+    }
+}
+
+RoutingTableEntry
+RoutingTable::GetEntry (uint32_t i) const
+{
+  PositionRecord r = GetRecord (i);
+  return RoutingTableEntry (r.m_x, r.m_y, r.m_z, r.m_vx, r.m_vy, r.m_vz,
+                            r.m_timestamp, Ipv4Address (r.m_addr));
+}
+
+PositionRecord
+RoutingTable::GetRecord (uint32_t i) const
+{
+  if (m_store != 0)
+    {
+      return m_store->Get (m_record[i]);
+    }
+  PositionRecord r = { m_addr[i], m_x[i], m_y[i], m_z[i], m_vx[i], m_vy[i], m_vz[i], m_timestamp[i] };
+  return r;
+}
+
+void
+RoutingTable::SetEntry (uint32_t i, const RoutingTableEntry & rt)
+{
+  if (m_store != 0)
+    {
+      // 记录不可修改，先引用新记录再释放旧记录，内容相同时旧记录不会被释放
+      PositionRecord r = { m_addr[i], rt.GetX (), rt.GetY (), rt.GetZ (),
+                           rt.GetVx (), rt.GetVy (), rt.GetVz (), rt.GetTimestamp () };
+      uint32_t old = m_record[i];
+      m_record[i] = m_store->Intern (r);
+      m_store->Release (old);
+      return;
+    }
+  m_x[i] = rt.GetX ();
+  m_y[i] = rt.GetY ();
+  m_z[i] = rt.GetZ ();
+  m_vx[i] = rt.GetVx ();
+  m_vy[i] = rt.GetVy ();
+  m_vz[i] = rt.GetVz ();
+  m_timestamp[i] = rt.GetTimestamp ();
+}
+
+uint32_t
+RoutingTable::CellKey (Vector pos) const
+{
+  // 预测位置被限制在1000*1000*300的范围内，每个维度占10位
+  double x = std::min (std::max (pos.x, 0.0), 1000.0);
+  double y = std::min (std::max (pos.y, 0.0), 1000.0);
+  double z = std::min (std::max (pos.z, 0.0), 300.0);
+  uint32_t cellSize = m_transRange > 0 ? m_transRange : 1;
+  uint32_t cx = (uint32_t)x / cellSize;
+  uint32_t cy = (uint32_t)y / cellSize;
+  uint32_t cz = (uint32_t)z / cellSize;
+  return (cx << 20) | (cy << 10) | cz;
+}
+
+void
+RoutingTable::IndexEntry (uint32_t i)
+{
+  // 网格过期时由RefreshGrid统一重建
+  int64_t now = Simulator::Now ().ToInteger (Time::S);
+  if (m_gridTime != now)
+    {
+      return;
+    }
+  Vector pos = PredictEntry (i, now);
+  IndexEntry (i, pos.x, pos.y, pos.z);
+}
+
+void
+RoutingTable::IndexEntry (uint32_t i, uint16_t px, uint16_t py, uint16_t pz)
+{
+  m_predX[i] = px;
+  m_predY[i] = py;
+  m_predZ[i] = pz;
+  if (!IsNeighborCandidate (Ipv4Address (m_addr[i])))
+    {
+      return;
+    }
+  uint32_t key = CellKey (Vector (px, py, pz));
+  m_grid[key].Add (i, px, py, pz);
+  m_cell[i] = key;
+  // 更新后的表项如果落在缓存的邻居候选范围内，同步加入
+  if (m_nearbyTime >= 0
+      && CalculateDistance (Vector (px, py, pz), m_nearbyAnchor) <= m_transRange * (1 + NEARBY_MARGIN))
+    {
+      m_nearby.Add (i, px, py, pz);
+      m_nearbyVersion++;
+    }
+}
+
+void
+RoutingTable::UnindexEntry (uint32_t i)
+{
+  if (m_cell[i] == NOT_INDEXED)
+    {
+      return;
+    }
+  std::map<uint32_t, GridCell>::iterator cell = m_grid.find (m_cell[i]);
+  if (cell != m_grid.end ())
+    {
+      cell->second.Remove (i);
+      if (cell->second.m_entry.empty ())
+        {
+          m_grid.erase (cell);
+        }
+    }
+  if (m_nearbyTime >= 0 && m_nearby.Remove (i))
+    {
+      m_nearbyVersion++;
+    }
+  m_cell[i] = NOT_INDEXED;
+}
+
+// 时间戳和预测都以秒为单位，同一秒内预测位置不变，所以网格和预测结果每秒最多重新计算一次
+void
+RoutingTable::RefreshGrid ()
+{
+  int64_t now = Simulator::Now ().ToInteger (Time::S);
+  if (m_gridTime == now)
+    {
+      return;
+    }
+  m_grid.clear ();
+  std::fill (m_cell.begin (), m_cell.end (), NOT_INDEXED);
+  m_nearby.Clear ();
+  m_nearbyTime = -1;
+  m_nearbyVersion++;
+  m_gridTime = now;
+  uint32_t n = m_addr.size ();
+  if (n == 0)
+    {
+      return;
+    }
+  // 一次性预测所有表项在当前秒的位置，其他运动模型和共享存储的表项逐个预测
+  if (IsConstantVelocity () && m_store == 0)
+    {
+      KinematicArrays in = { &m_x[0], &m_y[0], &m_z[0], &m_vx[0], &m_vy[0], &m_vz[0], &m_timestamp[0] };
+      PredictBatch (in, n, now, &m_predX[0], &m_predY[0], &m_predZ[0]);
+    }
+  else
+    {
+      for (uint32_t i = 0; i < n; ++i)
+        {
+          Vector pos = PredictEntry (i, now);
+          m_predX[i] = pos.x;
+          m_predY[i] = pos.y;
+          m_predZ[i] = pos.z;
+        }
+    }
+  for (uint32_t i = 0; i < n; ++i)
+    {
+      IndexEntry (i, m_predX[i], m_predY[i], m_predZ[i]);
+    }
+}
+
+const RoutingTable::GridCell &
+RoutingTable::NearbyEntries (Vector myPos)
+{
+  RefreshGrid ();
+  double margin = m_transRange * NEARBY_MARGIN;
+  // 节点在同一秒内移动不超过margin时，直接复用上次收集的候选邻居
+  if (m_nearbyTime == m_gridTime && CalculateDistance (myPos, m_nearbyAnchor) <= margin)
+    {
+      return m_nearby;
+    }
+  m_nearby.Clear ();
+  m_nearbyAnchor = myPos;
+  m_nearbyTime = m_gridTime;
+  m_nearbyVersion++;
+
+  double radius = m_transRange + margin;
+  int32_t cellSize = m_transRange > 0 ? m_transRange : 1;
+  int32_t reach = (int32_t) std::ceil (radius / cellSize);
+  uint32_t key = CellKey (myPos);
+  int32_t cx = key >> 20;
+  int32_t cy = (key >> 10) & 0x3ff;
+  int32_t cz = key & 0x3ff;
+  uint32_t hits[RANGE_CHUNK];
+  for (int32_t x = std::max (cx - reach, 0); x <= cx + reach; x++)
+    {
+      for (int32_t y = std::max (cy - reach, 0); y <= cy + reach; y++)
+        {
+          for (int32_t z = std::max (cz - reach, 0); z <= cz + reach; z++)
+            {
+              std::map<uint32_t, GridCell>::const_iterator cell = m_grid.find ((x << 20) | (y << 10) | z);
+              if (cell == m_grid.end ())
+                {
+                  continue;
+                }
+              const GridCell & c = cell->second;
+              for (uint32_t base = 0; base < c.m_entry.size (); base += RANGE_CHUNK)
+                {
+                  uint32_t n = std::min<uint32_t> (RANGE_CHUNK, c.m_entry.size () - base);
+                  uint32_t found = WithinRangeBatch (&c.m_px[base], &c.m_py[base], &c.m_pz[base], n, myPos, radius, hits);
+                  for (uint32_t k = 0; k < found; k++)
+                    {
+                      uint32_t j = base + hits[k];
+                      m_nearby.Add (c.m_entry[j], c.m_px[j], c.m_py[j], c.m_pz[j]);
+                    }
+                }
+            }
+        }
+    }
+  return m_nearby;
+}
+
+void
+RoutingTable::GridCell::Add (uint32_t i, uint16_t px, uint16_t py, uint16_t pz)
+{
+  m_entry.push_back (i);
+  m_px.push_back (px);
+  m_py.push_back (py);
+  m_pz.push_back (pz);
+}
+
+bool
+RoutingTable::GridCell::Remove (uint32_t i)
+{
+  std::vector<uint32_t>::iterator j = std::find (m_entry.begin (), m_entry.end (), i);
+  if (j == m_entry.end ())
+    {
+      return false;
+    }
+  uint32_t k = j - m_entry.begin ();
+  m_entry[k] = m_entry.back ();
+  m_px[k] = m_px.back ();
+  m_py[k] = m_py.back ();
+  m_pz[k] = m_pz.back ();
+  m_entry.pop_back ();
+  m_px.pop_back ();
+  m_py.pop_back ();
+  m_pz.pop_back ();
+  return true;
+}
+
+void
+RoutingTable::GridCell::Renumber (uint32_t from, uint32_t to)
+{
+  std::replace (m_entry.begin (), m_entry.end (), from, to);
+}
+
+void
+RoutingTable::GridCell::Clear ()
+{
+  m_entry.clear ();
+  m_px.clear ();
+  m_py.clear ();
+  m_pz.clear ();
+}
+
 }
 }
@@ -3,6 +3,7 @@
 
 #include <cassert>
 #include <map>
+#include <vector>
 #include <sys/types.h>
 #include "ns3/ipv4.h"
 #include "ns3/ipv4-route.h"
@@ -13,6 +14,8 @@
 #include "ns3/vector.h"
 // 添加移动模型
 #include "ns3/mobility-model.h"
+#include "myprotocol4-predictor.h"
+#include "myprotocol4-position-store.h"
 
 namespace ns3 {
 namespace myprotocol4 {
@@ -97,6 +100,7 @@ class RoutingTable
 public:
   /// c-tor
   RoutingTable ();
+  ~RoutingTable ();
   /**
    * Add routing table entry if it doesn't yet exist in routing table
    * \param r routing table entry
@@ -128,10 +132,7 @@ public:
   Update (RoutingTableEntry & rt);
   /// Delete all entries from routing table
   void
-  Clear ()
-  {
-    m_positionTable.clear ();
-  }
+  Clear ();
   /**
    * Print routing table
    * \param stream the output stream
@@ -147,15 +148,387 @@ public:
 
   Ipv4Address BestNeighbor (std::map<Ipv4Address, RoutingTableEntry> neighborTable, Vector dstPos, Vector myPos);    //dstPos需要时经过预测后的目的地位置
 
+  /**
+   * Single-pass equivalent of LookupNeighbor followed by BestNeighbor. Every
+   * neighbor is predicted once and nothing is allocated.
+   * \param myPos own position
+   * \param dstPos predicted position of the destination
+   * \param nextHop set to the neighbor closest to dstPos if it is closer than
+   *        myPos, to the zero address otherwise
+   * \returns the number of neighbors of myPos
+   */
+  uint32_t LookupNextHop (Vector myPos, Vector dstPos, Ipv4Address & nextHop);
+  /**
+   * LookupNextHop that also reports how far the caller may move before the
+   * result can change, as long as GetNeighborhoodVersion and dstPos are unchanged.
+   * \param myPos own position
+   * \param dstPos predicted position of the destination
+   * \param nextHop set like LookupNextHop
+   * \param stable the result stays valid for positions strictly closer than stable to myPos
+   * \returns the number of neighbors of myPos
+   */
+  uint32_t LookupNextHop (Vector myPos, Vector dstPos, Ipv4Address & nextHop, double & stable);
+  /**
+   * \returns a counter that changes whenever an entry near the position of
+   *          the last neighbor query is added, moved or removed, and when
+   *          the second changes
+   */
+  uint32_t GetNeighborhoodVersion () const
+  {
+    return m_nearbyVersion;
+  }
+
+  /**
+   * Remove expired entries. Entries are kept in a timing wheel of expiry
+   * deadlines, so the cost is O(1) unless some entry is due.
+   */
   void Purge();
 
+  /**
+   * \returns the number of entries in the table
+   */
+  uint32_t GetSize () const
+  {
+    return m_addr.size ();
+  }
+  /**
+   * \returns the approximate number of bytes allocated by the table,
+   *          without the records of a shared position store
+   */
+  uint64_t GetMemoryUsage () const;
+  /**
+   * Set the transmission range used for neighbor queries. It is also the
+   * edge length of the spatial grid cells.
+   * \param range the transmission range in meters
+   */
+  void SetTransRange (uint16_t range)
+  {
+    m_transRange = range;
+    m_gridTime = -1;
+    m_nearbyTime = -1;
+  }
+  /**
+   * \returns the transmission range in meters
+   */
+  uint16_t GetTransRange () const
+  {
+    return m_transRange;
+  }
+  /**
+   * Set the width of a timing wheel bucket. An expired entry is removed by
+   * Purge at most granularity - 1 seconds after its deadline.
+   * \param granularity the bucket width in seconds, at least 1
+   */
+  void SetPurgeGranularity (uint16_t granularity);
+  /**
+   * \returns the bucket width of the timing wheel in seconds
+   */
+  uint16_t GetPurgeGranularity () const
+  {
+    return m_purgeGranularity;
+  }
+  /**
+   * Set how long entries live. Dead reckoning may be off by up to the
+   * speed times the age of a report, since a node can turn at any time. An
+   * entry therefore expires once speed * age reaches the error budget,
+   * but never before minLifeTime nor after maxLifeTime seconds.
+   * \param errorBudget the position error in meters, 0 to keep every entry maxLifeTime seconds
+   * \param minLifeTime the shortest lifetime in seconds
+   * \param maxLifeTime the longest lifetime in seconds
+   */
+  void SetEntryLifeTime (double errorBudget, uint16_t minLifeTime, uint16_t maxLifeTime);
+  /**
+   * Set the motion model used to predict positions. Every new report of an
+   * entry is passed to it. Constant-velocity prediction, also used when no
+   * predictor is set, runs in the batch kernels; other models are evaluated
+   * entry by entry.
+   * \param predictor the predictor, set before entries are added
+   */
+  void SetPredictor (Ptr<MotionPredictor> predictor)
+  {
+    m_predictor = predictor;
+    m_gridTime = -1;
+    m_nearbyTime = -1;
+  }
+  /**
+   * \returns the predictor, null for constant velocity
+   */
+  Ptr<MotionPredictor> GetPredictor () const
+  {
+    return m_predictor;
+  }
+  /**
+   * Keep the reports of the entries in a store shared with other tables
+   * instead of in this table. Each entry then holds a reference to the
+   * record it has learned. The entries already in the table are moved to
+   * the store.
+   * \param store the store, null to keep the reports in this table
+   */
+  void SetPositionStore (Ptr<PositionStore> store);
+  /**
+   * \returns the position store, null if the reports are kept in this table
+   */
+  Ptr<PositionStore> GetPositionStore () const
+  {
+    return m_store;
+  }
+
 private:
-  // 表项过期时间
-  uint16_t m_entryLifeTime;
-  /// an entry in the routing table.
-  std::map<Ipv4Address, RoutingTableEntry> m_positionTable;
-  /// neighbor table
-  std::map<Ipv4Address, RoutingTableEntry> m_neiborTable;
+  /// marks a slot of m_slots as free
+  static const uint32_t EMPTY_SLOT = 0;
+  /// marks an entry that is not stored in the grid
+  static const uint32_t NOT_INDEXED = 0xffffffff;
+
+  /// A set of entries with their predicted positions, stored as parallel arrays
+  struct GridCell
+  {
+    /**
+     * Append an entry.
+     * \param i the dense index
+     * \param px predicted x
+     * \param py predicted y
+     * \param pz predicted z
+     */
+    void Add (uint32_t i, uint16_t px, uint16_t py, uint16_t pz);
+    /**
+     * Remove an entry, moving the last entry into its place.
+     * \param i the dense index
+     * \returns true if the entry was in the set
+     */
+    bool Remove (uint32_t i);
+    /**
+     * Replace dense index from by to after the table moved an entry.
+     * \param from the old dense index
+     * \param to the new dense index
+     */
+    void Renumber (uint32_t from, uint32_t to);
+    /// Remove all entries
+    void Clear ();
+
+    std::vector<uint32_t> m_entry;      ///< dense indices of the entries
+    std::vector<uint16_t> m_px;         ///< predicted x of the entries
+    std::vector<uint16_t> m_py;         ///< predicted y of the entries
+    std::vector<uint16_t> m_pz;         ///< predicted z of the entries
+  };
+
+  /**
+   * Check whether an entry may be reported as a neighbor. Loopback and
+   * broadcast entries only exist for bookkeeping.
+   * \param id the entry address
+   * \returns true if the entry is a neighbor candidate
+   */
+  static bool IsNeighborCandidate (Ipv4Address id);
+  /**
+   * \param key the 32-bit address
+   * \returns the home slot of key in m_slots
+   */
+  uint32_t HomeSlot (uint32_t key) const;
+  /**
+   * \param key the 32-bit address
+   * \returns the slot holding key, or the free slot where key would be stored
+   */
+  uint32_t FindSlot (uint32_t key) const;
+  /**
+   * \param id the entry address
+   * \returns the dense index of the entry, or -1 if there is none
+   */
+  int32_t Find (Ipv4Address id) const;
+  /**
+   * Append a new entry to the dense arrays and index it. The address must not be present.
+   * \param rt the entry
+   * \returns the dense index of the entry
+   */
+  uint32_t Insert (const RoutingTableEntry & rt);
+  /**
+   * Remove the entry at dense index i, moving the last entry into its place.
+   * \param i the dense index
+   */
+  void Erase (uint32_t i);
+  /**
+   * Grow the hash index to capacity slots and reinsert all entries.
+   * \param capacity the new number of slots, a power of two
+   */
+  void Rehash (uint32_t capacity);
+  /// \returns the entry at dense index i
+  RoutingTableEntry GetEntry (uint32_t i) const;
+  /// \returns the report of the entry at dense index i
+  PositionRecord GetRecord (uint32_t i) const;
+  /**
+   * Overwrite the entry at dense index i, keeping its address.
+   * \param i the dense index
+   * \param rt the new values
+   */
+  void SetEntry (uint32_t i, const RoutingTableEntry & rt);
+  /**
+   * Dead-reckon the entry at dense index i to second now.
+   * \param i the dense index
+   * \param now the current simulation second
+   * \returns the predicted position
+   */
+  Vector PredictEntry (uint32_t i, int64_t now) const;
+  /**
+   * \returns true if predictions are plain constant-velocity dead reckoning
+   */
+  bool IsConstantVelocity () const
+  {
+    return m_predictor == 0 || m_predictor->IsConstantVelocity ();
+  }
+  /**
+   * Pass the report stored at dense index i to the predictor.
+   * \param i the dense index
+   */
+  void ObserveEntry (uint32_t i);
+  /**
+   * \param pos a position inside the simulation area
+   * \returns the key of the grid cell containing pos
+   */
+  uint32_t CellKey (Vector pos) const;
+  /**
+   * Insert the entry at dense index i into the grid cell of its predicted position.
+   * \param i the dense index
+   */
+  void IndexEntry (uint32_t i);
+  /**
+   * Insert the entry at dense index i into the grid cell of position (px, py, pz).
+   * \param i the dense index
+   * \param px predicted x
+   * \param py predicted y
+   * \param pz predicted z
+   */
+  void IndexEntry (uint32_t i, uint16_t px, uint16_t py, uint16_t pz);
+  /**
+   * Remove the entry at dense index i from the grid, if indexed.
+   * \param i the dense index
+   */
+  void UnindexEntry (uint32_t i);
+  /// Expiry deadline of an entry, as stored in the timing wheel
+  struct Expiry
+  {
+    uint32_t m_addr;        ///< address of the entry
+    int64_t m_deadline;     ///< second in which the entry expires
+  };
+  /**
+   * Add an expiry record for the entry at dense index i.
+   * \param i the dense index
+   */
+  void ScheduleExpiry (uint32_t i);
+  /**
+   * \param i the dense index
+   * \returns the second in which the entry at dense index i expires, from its speed and timestamp
+   */
+  int64_t EntryDeadline (uint32_t i) const;
+  /**
+   * \param i the dense index
+   * \returns the deadline the entry at dense index i was last scheduled with in the timing wheel
+   */
+  int64_t ScheduledDeadline (uint32_t i) const;
+  /**
+   * Put an expiry record into the bucket of its deadline, or into the
+   * overdue list if that bucket was already processed.
+   * \param e the record
+   */
+  void ScheduleExpiry (const Expiry & e);
+  /**
+   * Remove the entry of a record if the record is current and due. Records
+   * made stale by Update or DeleteRoute are dropped, records beyond the
+   * horizon of the wheel are scheduled again.
+   * \param e the record
+   * \param now the current simulation second
+   */
+  void Expire (const Expiry & e, int64_t now);
+  /// Rebuild the grid and the predictions if they were computed in an earlier second
+  void RefreshGrid ();
+  /**
+   * Neighbor candidates of myPos in the current second. The set of entries
+   * within range plus a margin of an anchor position is memoized, and
+   * reused for every query position within the margin of the anchor.
+   * \param myPos own position
+   * \returns a superset of the entries within range of myPos
+   */
+  const GridCell & NearbyEntries (Vector myPos);
+  /**
+   * Implementation of both LookupNextHop variants.
+   * \param myPos own position
+   * \param dstPos predicted position of the destination
+   * \param nextHop the chosen neighbor (output)
+   * \param stable if not null, set to the distance myPos may move without changing the result
+   * \returns the number of neighbors of myPos
+   */
+  uint32_t FindNextHop (Vector myPos, Vector dstPos, Ipv4Address & nextHop, double *stable);
+
+  // 表项过期时间，根据速度在最短和最长时间之间调整
+  uint16_t m_minLifeTime;
+  uint16_t m_maxLifeTime;
+  /// position error in meters after which an entry expires, 0 for the fixed lifetime m_maxLifeTime
+  double m_errorBudget;
+  /**
+   * Position table in structure-of-arrays layout. Entry i is stored at
+   * index i of every array below; entries are kept dense by moving the
+   * last entry into the hole left by a removal.
+   */
+  std::vector<uint32_t> m_addr;
+  std::vector<uint16_t> m_x;
+  std::vector<uint16_t> m_y;
+  std::vector<uint16_t> m_z;
+  std::vector<int16_t> m_vx;
+  std::vector<int16_t> m_vy;
+  std::vector<int16_t> m_vz;
+  std::vector<uint16_t> m_timestamp;
+  /**
+   * Id of the report of each entry in m_store. When a store is set, the
+   * kinematic arrays above, m_timestamp and m_deadline are empty; the
+   * deadline is recomputed from the shared report.
+   */
+  std::vector<uint32_t> m_record;
+  /// store of the reports shared with other tables, null if they are kept in this table
+  Ptr<PositionStore> m_store;
+  /// second in which the entry expires, as last scheduled in the timing wheel
+  std::vector<int64_t> m_deadline;
+  /**
+   * Open-addressing hash index on the 32-bit address with linear probing.
+   * Each slot holds dense index + 1, or EMPTY_SLOT. The size is a power of
+   * two and at most half of the slots are in use.
+   */
+  std::vector<uint32_t> m_slots;
+  /**
+   * Timing wheel of expiry deadlines. Bucket k covers deadlines in
+   * [k * m_purgeGranularity, (k + 1) * m_purgeGranularity) and is stored in
+   * slot k modulo the number of slots. A record is added whenever the
+   * deadline of an entry changes; outdated records are skipped lazily.
+   */
+  std::vector<std::vector<Expiry> > m_wheel;
+  /// records whose bucket was already processed when they were added
+  std::vector<Expiry> m_overdue;
+  /// width of a bucket in seconds
+  uint16_t m_purgeGranularity;
+  /// last second processed by Purge, -1 before the first call
+  int64_t m_wheelTime;
+  /// transmission range, also the grid cell size
+  uint16_t m_transRange;
+  /// Uniform 3D grid over predicted positions, cell key -> entries in the cell
+  std::map<uint32_t, GridCell> m_grid;
+  /// dense index -> key of the grid cell the entry is stored in, or NOT_INDEXED
+  std::vector<uint32_t> m_cell;
+  /// second in which the grid and the predictions were computed, -1 if they have to be recomputed
+  int64_t m_gridTime;
+  /**
+   * Predicted position of every entry in second m_gridTime, indexed like
+   * the entry arrays. Positions only change once per second, so they are
+   * computed in one batch per second and per entry by Update.
+   */
+  std::vector<uint16_t> m_predX;
+  std::vector<uint16_t> m_predY;
+  std::vector<uint16_t> m_predZ;
+  /// memoized entries within range plus margin of m_nearbyAnchor
+  GridCell m_nearby;
+  /// the position m_nearby was collected around
+  Vector m_nearbyAnchor;
+  /// second in which m_nearby was collected, -1 if it is invalid
+  int64_t m_nearbyTime;
+  /// incremented whenever m_nearby changes
+  uint32_t m_nearbyVersion;
+  /// motion model of the predictions, null for constant velocity
+  Ptr<MotionPredictor> m_predictor;
 };
 }
 }